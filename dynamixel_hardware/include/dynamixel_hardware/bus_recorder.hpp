@@ -0,0 +1,141 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__BUS_RECORDER_HPP_
+#define DYNAMIXEL_HARDWARE__BUS_RECORDER_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "dynamixel_hardware/register_layout.hpp"
+
+namespace dynamixel_hardware
+{
+constexpr uint32_t kRecordMagic = 0x52584c44;  // "DXLR"
+constexpr uint32_t kRecordVersion = 3;
+constexpr std::size_t kRecordSize = 512;
+constexpr std::size_t kRecordMaxJoints = 32;
+// Goal_Position alone, the indirect goal block and the end-effector block
+constexpr std::size_t kRecordGoalWrites = 3;
+
+enum class RecordKind : uint8_t {
+  SyncRead = 1,
+  SyncWrite = 2,
+};
+
+// One sync read or sync write. The payload holds count entries of an id followed by length
+// data bytes, as on the bus; for reads only the servos that answered.
+struct BusRecord
+{
+  // steady clock
+  int64_t monotonic_ns;
+  // number of the record in the recording, written last
+  std::atomic<uint64_t> index;
+  RecordKind kind;
+  uint8_t count;
+  uint16_t address;
+  uint16_t length;
+  uint8_t reserved[2];
+  uint8_t payload[kRecordSize - 24];
+};
+
+struct RecordJoint
+{
+  char name[32];
+  uint8_t id;
+  uint8_t reserved[3];
+  // Current_Limit the goal currents were clamped to
+  int32_t current_limit;
+  ValueScale scale;
+};
+
+// Recording file: a RecordFileHeader followed by capacity BusRecord slots used as a ring.
+// Record n is in slot n % capacity, next is the number of the record written next.
+struct RecordFileHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t record_size;
+  uint64_t capacity;
+  std::atomic<uint64_t> next;
+  // where the present items lie in the read data
+  uint16_t read_address;
+  uint16_t read_length;
+  uint8_t position_offset;
+  uint8_t position_length;
+  uint8_t velocity_offset;
+  uint8_t velocity_length;
+  uint8_t current_offset;
+  uint8_t current_length;
+  uint16_t goal_velocity_address;
+  uint16_t goal_current_address;
+  uint8_t goal_velocity_length;
+  uint8_t goal_current_length;
+  // writes of goal_length bytes to one of these addresses carry Goal_Position and Goal_Current
+  // at the matching offsets, unused entries are zero
+  uint16_t goal_address[kRecordGoalWrites];
+  uint8_t goal_length[kRecordGoalWrites];
+  uint8_t goal_position_offset[kRecordGoalWrites];
+  uint8_t goal_position_length;
+  uint8_t goal_current_offset[kRecordGoalWrites];
+  uint32_t joint_count;
+  uint32_t reserved;
+  RecordJoint joints[kRecordMaxJoints];
+};
+
+static_assert(sizeof(BusRecord) == kRecordSize, "BusRecord layout changed");
+static_assert(sizeof(RecordJoint) == 88, "RecordJoint layout changed");
+static_assert(offsetof(RecordFileHeader, joints) == 72, "RecordFileHeader layout changed");
+
+// Appends bus transactions to a preallocated, memory-mapped ring file. Appending only
+// touches mapped memory, the kernel writes the pages back.
+class BusRecorder
+{
+public:
+  ~BusRecorder();
+
+  // Creates path with room for capacity records and maps it. The header is left to the
+  // caller to fill in.
+  bool open(const std::string & path, const uint64_t capacity, std::string & error);
+
+  void close();
+
+  bool is_open() const { return header_ != nullptr; }
+
+  RecordFileHeader * header() { return header_; }
+
+  // Records count servos of an id followed by length bytes each, from params.
+  void append(
+    const RecordKind kind, const uint16_t address, const uint16_t length, const uint8_t * params,
+    const std::size_t count);
+
+  // Starts a record to be filled in place and finished with commit().
+  BusRecord & begin(const RecordKind kind, const uint16_t address, const uint16_t length);
+
+  void commit(BusRecord & record);
+
+  // Number of entries of length data bytes that fit in a record.
+  static std::size_t capacity_for(const uint16_t length);
+
+private:
+  std::size_t size_{0};
+  RecordFileHeader * header_{nullptr};
+  BusRecord * records_{nullptr};
+};
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__BUS_RECORDER_HPP_
@@ -0,0 +1,83 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__BUS_REPLAY_HPP_
+#define DYNAMIXEL_HARDWARE__BUS_REPLAY_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "dynamixel_hardware/bus_recorder.hpp"
+
+namespace dynamixel_hardware
+{
+// Plays back a recording of BusRecorder: the sync reads as the bus would have answered them,
+// and the recorded sync writes to compare the ones sent in their place against.
+class BusReplay
+{
+public:
+  ~BusReplay();
+
+  bool open(const std::string & path, std::string & error);
+
+  void close();
+
+  bool is_open() const { return header_ != nullptr; }
+
+  const RecordFileHeader * header() const { return header_; }
+
+  // Returns the next sync read, or nullptr when none is due. With realtime the reads are due
+  // at their recorded times counted from the first call, and the ones that fell behind are
+  // skipped; otherwise every call returns the next one.
+  const BusRecord * next_read(const bool realtime);
+
+  bool finished() const { return position_ >= end_; }
+
+  // Compares a sync write with the first recorded write to the same address since the read
+  // last returned. Returns false when it differs or was not recorded. Writes are not compared
+  // while no read is due.
+  bool compare_write(
+    const uint16_t address, const uint16_t length, const uint8_t * params,
+    const std::size_t count);
+
+  uint64_t reads() const { return reads_; }
+  uint64_t skipped_reads() const { return skipped_reads_; }
+  uint64_t compared_writes() const { return compared_writes_; }
+  uint64_t mismatched_writes() const { return mismatched_writes_; }
+  uint64_t unrecorded_writes() const { return unrecorded_writes_; }
+
+private:
+  // nullptr for a record that was being written when the recording stopped
+  const BusRecord * record(const uint64_t index) const;
+
+  std::size_t size_{0};
+  const RecordFileHeader * header_{nullptr};
+  const BusRecord * records_{nullptr};
+  uint64_t position_{0};
+  uint64_t end_{0};
+  uint64_t write_position_{0};
+  bool comparing_{false};
+  int64_t first_ns_{0};
+  std::chrono::steady_clock::time_point start_{};
+  uint64_t reads_{0};
+  uint64_t skipped_reads_{0};
+  uint64_t compared_writes_{0};
+  uint64_t mismatched_writes_{0};
+  uint64_t unrecorded_writes_{0};
+};
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__BUS_REPLAY_HPP_
@@ -0,0 +1,113 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__BUS_THREAD_HPP_
+#define DYNAMIXEL_HARDWARE__BUS_THREAD_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace dynamixel_hardware
+{
+struct BusThreadConfig
+{
+  // SCHED_FIFO priority, 0 keeps the default scheduling policy
+  int priority{0};
+  // CPU the thread is pinned to, -1 for no affinity
+  int cpu{-1};
+};
+
+struct JitterStats
+{
+  double mean_us{0.0};
+  double max_us{0.0};
+};
+
+// Dedicated thread running the serial transactions of read() and write() with real-time
+// scheduling. Jobs are handed over synchronously and without allocation.
+class BusThread
+{
+public:
+  ~BusThread();
+
+  // Starts the thread and applies the scheduling policy and affinity. Returns false and fills
+  // error when the requested settings could not be applied; the thread keeps running then.
+  bool start(const BusThreadConfig & config, std::string & error);
+
+  void stop();
+
+  bool running() const { return thread_.joinable(); }
+
+  // Runs job on the bus thread and waits for it to finish.
+  template <typename Job>
+  void run(Job & job)
+  {
+    run(&invoke<Job>, &job);
+  }
+
+  // Runs job on the bus thread every period with absolute wake-ups until stop(). Jobs handed
+  // over with run() are run in between. job has to outlive the thread.
+  template <typename Job>
+  void run_periodic(const std::chrono::microseconds period, Job & job)
+  {
+    run_periodic(period, &invoke<Job>, &job);
+  }
+
+  // Periodic jobs that ran past the start of the next period.
+  uint64_t overruns() const { return overruns_.load(); }
+
+  // Scheduling policy, priority and CPU the thread actually got, as seen from the thread.
+  std::string describe();
+
+  // Wake-up latency of a periodic absolute sleep on the calling thread.
+  static JitterStats measure_jitter(const std::chrono::microseconds period, const int iterations);
+
+  // Locks current and future pages of the process in memory.
+  static bool lock_memory(std::string & error);
+
+private:
+  template <typename Job>
+  static void invoke(void * job)
+  {
+    (*static_cast<Job *>(job))();
+  }
+
+  void run(void (*function)(void *), void * argument);
+
+  void run_periodic(
+    const std::chrono::microseconds period, void (*function)(void *), void * argument);
+
+  void loop();
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  void (*function_)(void *){nullptr};
+  void * argument_{nullptr};
+  bool pending_{false};
+  bool stopping_{false};
+  // only touched on the bus thread
+  std::chrono::microseconds period_{0};
+  void (*periodic_function_)(void *){nullptr};
+  void * periodic_argument_{nullptr};
+  std::atomic<uint64_t> overruns_{0};
+};
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__BUS_THREAD_HPP_
@@ -15,6 +15,7 @@
 #ifndef DYNAMIXEL_HARDWARE__DYNAMIXEL_HARDWARE_HPP_
 #define DYNAMIXEL_HARDWARE__DYNAMIXEL_HARDWARE_HPP_
 
+#include <dynamixel_sdk/dynamixel_sdk.h>
 #include <dynamixel_workbench_toolbox/dynamixel_workbench.h>
 
 #include <hardware_interface/base_interface.hpp>
@@ -23,10 +24,30 @@
 #include <hardware_interface/system_interface.hpp>
 #include <hardware_interface/types/hardware_interface_return_values.hpp>
 #include <hardware_interface/types/hardware_interface_status_values.hpp>
-#include <map>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "dynamixel_hardware/bus_recorder.hpp"
+#include "dynamixel_hardware/bus_replay.hpp"
+#include "dynamixel_hardware/bus_thread.hpp"
+#include "dynamixel_hardware/protocol1.hpp"
+#include "dynamixel_hardware/protocol2.hpp"
+#include "dynamixel_hardware/serial_port.hpp"
+#include "dynamixel_hardware/register_layout.hpp"
+#include "dynamixel_hardware/response_timeouts.hpp"
+#include "dynamixel_hardware/servo_series.hpp"
+#include "dynamixel_hardware/setpoint_queue.hpp"
+#include "dynamixel_hardware/state_snapshot.hpp"
 #include "dynamixel_hardware/visiblity_control.h"
 #include "rclcpp/macros.hpp"
 
@@ -41,11 +62,34 @@ struct JointValue
   double effort{0.0};
 };
 
+struct GoalProfile
+{
+  double velocity{0.0};
+  double acceleration{0.0};
+  double current{0.0};
+};
+
+// health of a joint's servo on the bus, exported as state interfaces
+struct JointDiagnostics
+{
+  // learned timeouts of the first read of a cycle and of its retries in seconds, NaN until
+  // learned
+  double response_timeout{std::numeric_limits<double>::quiet_NaN()};
+  double retry_timeout{std::numeric_limits<double>::quiet_NaN()};
+  // 1.0 while the state is not from the latest read cycle
+  double stale{1.0};
+  // 1.0 while the servo is left out of the sync reads and writes
+  double evicted{0.0};
+};
+
 struct Joint
 {
   std::string name{};
   JointValue state{};
   JointValue command{};
+  GoalProfile profile{};
+  // duty cycle in % for PWM control, NaN while no controller holds it
+  double pwm{std::numeric_limits<double>::quiet_NaN()};
 };
 
 enum class ControlMode {
@@ -65,6 +109,9 @@ class DynamixelHardware
 public:
   RCLCPP_SHARED_PTR_DEFINITIONS(DynamixelHardware)
 
+  DYNAMIXEL_HARDWARE_PUBLIC
+  ~DynamixelHardware();
+
   DYNAMIXEL_HARDWARE_PUBLIC
   return_type configure(const hardware_interface::HardwareInfo & info) override;
 
@@ -87,23 +134,360 @@ public:
   return_type write() override;
 
 private:
+  // Joints of one servo series, converted by the kernels of its codec. The kernels of the
+  // encode functions append the goals of the group to write_params_ after count others.
+  struct JointGroup
+  {
+    const char * series{nullptr};
+    // joints in extended position mode, whose positions are unwrapped
+    bool extended{false};
+    bool (*matches)(const RegisterLayout &, const ValueScale &){nullptr};
+    void (DynamixelHardware::*decode)(const JointGroup &){nullptr};
+    std::size_t (DynamixelHardware::*encode_position)(const JointGroup &, std::size_t){nullptr};
+    std::size_t (DynamixelHardware::*encode_velocity)(const JointGroup &, std::size_t){nullptr};
+    std::size_t (DynamixelHardware::*encode_current)(const JointGroup &, std::size_t){nullptr};
+    std::vector<std::size_t> indices{};
+  };
+
   return_type enable_torque(const bool enabled);
 
+  // Switches the arm joints. The end-effectors are put in current-based position control with
+  // force_set only. While reconnecting the switch is left to the reconnect thread.
   return_type set_control_mode(const ControlMode & mode, const bool force_set = false);
 
+  // The writes of set_control_mode().
+  return_type switch_control_mode(const ControlMode & mode, const bool force_set);
+
+  // Turns the torque of the given servos on or off without touching torque_enabled_.
+  return_type switch_torque(const std::vector<uint8_t> & ids, const bool enabled);
+
+  // The mode a joint is in while the arm is in mode.
+  ControlMode joint_mode(const std::size_t index, const ControlMode mode) const;
+
+  // Puts a servo in mode: Operating_Mode on Protocol 2.0, the angle limits of joint, wheel or
+  // multi-turn mode on Protocol 1.0. Only the registers that differ are written, with the
+  // torque turned off first, and written tells whether any was. Returns false when the servo
+  // has no such mode or does not answer.
+  bool write_mode(const std::size_t index, const ControlMode mode, bool & written);
+
+  // Read or write one register of a servo and wait for its status packet. They are used after
+  // configure instead of the workbench, whose port does not survive a reconnect, by whichever
+  // side owns the port: the bus side, or the reconnect thread while reconnecting_.
+  bool read_register(const uint8_t id, const RegisterItem & item, int32_t & value);
+  bool write_register(const uint8_t id, const RegisterItem & item, const int32_t value);
+
+  // Sends the instruction packet of size bytes and waits for the status packet of id with at
+  // least length data bytes, left in data.
+  bool transact(
+    const uint8_t id, const std::size_t size, const uint16_t length, const uint8_t *& data);
+
   return_type reset_command();
 
+  // The same from the bus thread. While streaming, the commands the controllers see belong to
+  // their thread, so only the bus side is reset here and read() resets the rest.
+  void reset_bus_command();
+
+  // Switches the servos between full status returns for the acknowledged writes and the
+  // configured status_return_level. Only sends when the level changes, which with
+  // status_return_level 2, the only one on Protocol 1.0, is once.
+  void acknowledge_writes(const bool enabled);
+
+  void write_status_return_level(const int level);
+
+  // Sets Return_Delay_Time and checks Status_Return_Level on every servo, and logs the sync read
+  // latency before and after.
+  return_type tune_servos();
+
+  // Average time of a complete sync read over a few, NaN when none completed.
+  double measure_read_latency();
+
+  return_type read_bus();
+
+  // Hands the port over to a background thread that reopens it, together with a copy of the
+  // torque and control mode to restore. Until it is back, the bus side does not touch the port,
+  // the packet buffers or the state of the servos: read_bus() and write_bus() return at once,
+  // with the states flagged stale, and the mode and torque switches are left to the thread.
+  void start_reconnect();
+
+  // Hands a torque or mode switch to the reconnect thread. False when the port is back already.
+  bool defer_switch(const bool torque_enabled, const ControlMode mode);
+
+  void reconnect_loop();
+
+  // Reopens the port, waits for every servo not evicted to answer and restores their operating
+  // mode and torque with single-servo reads and writes, again as long as switches were deferred
+  // meanwhile. Gives the port back to the bus side when it succeeds.
+  bool reconnect();
+
+  // Converts the read data of the joints received in this cycle into their states, and evicts
+  // and readmits servos.
+  void decode_read();
+
+  // Whether a joint is still to be read in this cycle, evicted ones only when probed.
+  bool read_pending(const std::size_t index) const
+  {
+    return !read_received_[index] &&
+           (!evicted_[index] || static_cast<int>(index) == probe_index_);
+  }
+
+  return_type write_bus();
+
+  // Starts the bus thread from the bus_thread_* parameters and reports what it got.
+  return_type configure_bus_thread();
+
+  // Estimates the time of a read and write cycle on the bus and checks it against bus_rate or
+  // update_rate.
+  return_type plan_bus_budget(const std::string & usb_port);
+
+  // Runs the bus I/O at bus_rate on the bus thread. write() then only queues the commands with
+  // a timestamp, and the bus thread interpolates them stream_delay_ms in the past.
+  return_type configure_stream(const double bus_rate);
+
+  void stream_tick();
+
+  // Hands the state read on the bus thread over to read().
+  void publish_stream_state();
+
+  // Lays out the registers read every cycle as one block, through the Indirect Address table
+  // when the servos have one, and verifies the mapping of every servo.
+  return_type configure_read_block(const bool use_indirect);
+
+  // Lays out Goal_Position, Profile_Velocity, Profile_Acceleration and Goal_Current in the
+  // indirect entries following the read block, so that one sync write carries all of them.
+  return_type configure_write_block();
+
+  // Looks up an item on the first servo, trying the given names in order.
+  bool find_item(RegisterItem & item, std::initializer_list<const char *> names);
+
+  // Writes the addresses of the items into the Indirect Address table of every servo from the
+  // given entry on and reads them back.
+  return_type map_indirect(
+    const std::vector<RegisterItem *> & items, const uint16_t first_entry);
+
+  return_type write_goal_block(
+    const RegisterLayout & layout, const std::vector<std::size_t> & indices,
+    std::vector<uint8_t> & params, const bool interpolate);
+
+  // Lays out the sync write of the end-effectors, Goal_Position together with Goal_Current in
+  // the indirect goal block, and otherwise each in a sync write of its own.
+  void configure_gripper_block();
+
+  // Sends the goals of the end-effectors by the layout configure_gripper_block() chose.
+  return_type write_gripper_goals();
+
+  // Groups the joints by the servo series whose registers and units they match, the others
+  // fall back to the generic conversions.
+  void configure_groups();
+
+  // Sets up the unwrapping of the joints with extended_position, which need a full turn.
+  return_type configure_multi_turn();
+
+  std::vector<JointGroup> make_groups(const std::vector<std::size_t> & indices) const;
+
+  template<typename Codec>
+  static JointGroup make_group();
+
+  template<typename Codec>
+  void decode_group(const JointGroup & group);
+
+  template<typename Codec>
+  std::size_t encode_position_group(const JointGroup & group, std::size_t count);
+
+  template<typename Codec>
+  std::size_t encode_velocity_group(const JointGroup & group, std::size_t count);
+
+  template<typename Codec>
+  std::size_t encode_current_group(const JointGroup & group, std::size_t count);
+
+  // Derives Profile_Velocity and Profile_Acceleration from the move to the new position goals
+  // and the time since the previous ones. Returns false when no goal changed.
+  bool update_profiles(const std::vector<std::size_t> & indices);
+
+  // Builds and sends a sync write, false when the port failed.
+  bool transmit_sync_write(
+    const uint16_t address, const uint16_t length, const uint8_t * params,
+    const std::size_t count);
+
+  // Sends a sync write of count servos of an id followed by length bytes each, and accounts and
+  // records it. While replaying it is compared with the recording instead.
+  void send_sync_write(
+    const uint16_t address, const uint16_t length, uint8_t * params, const std::size_t count);
+
+  // Creates the shared memory state snapshot and fills in what does not change.
+  return_type configure_snapshot(const std::string & name);
+
+  // Publishes the cycle that started at start to the state snapshot.
+  void publish_snapshot(const std::chrono::steady_clock::time_point start);
+
+  // Opens the bus recording and stores what the decoder needs to know about the layout.
+  return_type configure_recorder(const std::string & path);
+
+  // Opens a bus recording to replay instead of the bus and takes the layout from it.
+  return_type configure_replay(const std::string & path);
+
+  // Feeds the next recorded sync read due to the joints.
+  return_type read_replay();
+
+  // Logs the bus load and the position tracking error every bus_stats_period_ms.
+  void update_bus_stats();
+
+  // Sync-writes the effort commands of the arm as Goal_Current, clamped to the Current_Limit of
+  // each servo.
+  return_type write_goal_current();
+
+  // Sync-writes the PWM commands of the arm as Goal_PWM, clamped to the PWM_Limit of each
+  // servo.
+  return_type write_goal_pwm();
+
+  // Sync-reads every joint that has not been received yet in this cycle.
+  // Status packets are accepted in any order and by id, so a missing servo does not discard
+  // the ones that did answer. Returns the number of joints received by this transaction.
+  std::size_t sync_read(
+    const bool clamp_timeout, const std::chrono::steady_clock::time_point deadline);
+
+  // The same for Protocol 1.0 servos, with one Bulk Read or with one Read per servo, each sent
+  // as soon as the status packet of the previous one is in. The retries always read one by
+  // one, as a missing servo keeps the ones after it from answering a Bulk Read.
+  std::size_t legacy_read(
+    const bool clamp_timeout, const std::chrono::steady_clock::time_point deadline);
+
+  // Parses the Protocol 1.0 status packets of up to count servos until the deadline.
+  std::size_t receive_legacy(
+    const std::size_t count, const Transaction transaction,
+    const std::chrono::steady_clock::time_point sent,
+    const std::chrono::steady_clock::time_point deadline);
+
+  // Takes the read data of a servo that is still pending and learns its response time.
+  bool store_read(
+    const Transaction transaction, const std::chrono::steady_clock::time_point sent,
+    const uint8_t id, const uint8_t * data, const uint16_t length);
+
+  // The longest learned timeout of the pending servos, zero unless all of them have one.
+  ResponseTimeouts::Duration pending_timeout(const Transaction transaction) const;
+
+  // Counts a miss of the learned timeout for the servos of read_params_ that did not answer.
+  void count_misses(const Transaction transaction);
+
+  // Chooses between Bulk Read and single reads for Protocol 1.0 servos from protocol1_read,
+  // measuring both when the servos answer a Bulk Read.
+  return_type configure_legacy_read();
+
   DynamixelWorkbench dynamixel_workbench_;
-  std::map<const char * const, const ControlItem *> control_items_;
+  SerialPort serial_port_;
+  // set from the return delays and the USB latency by plan_bus_budget()
+  std::chrono::nanoseconds response_margin_{0};
+  // the same for the status packet of a single servo
+  std::chrono::nanoseconds read_margin_{0};
+  ResponseTimeouts response_timeouts_;
+  // empty unless status_return_level is set
+  std::vector<uint8_t> status_return_params_;
+  RegisterItem status_return_item_;
+  RegisterItem torque_enable_item_;
+  // Operating_Mode on Protocol 2.0, the angle limits on Protocol 1.0
+  RegisterItem operating_mode_item_;
+  RegisterItem cw_angle_limit_item_;
+  RegisterItem ccw_angle_limit_item_;
+  int status_return_level_{2};
+  // the level last written, -1 when unknown
+  int written_status_return_level_{-1};
+  std::vector<JointDiagnostics> diagnostics_;
+  std::string usb_port_;
+  std::chrono::milliseconds reconnect_period_{500};
+  std::atomic<bool> reconnecting_{false};
+  std::thread reconnect_thread_;
+  std::mutex reconnect_mutex_;
+  std::condition_variable reconnect_condition_;
+  bool reconnect_stop_{false};
+  // the torque and control mode the reconnect thread restores
+  std::mutex reconnect_switch_mutex_;
+  bool reconnect_torque_enabled_{false};
+  ControlMode reconnect_control_mode_{ControlMode::Position};
+  Protocol2 protocol_;
+  bool fast_sync_read_{false};
+  Protocol1 protocol1_;
+  bool use_protocol1_{false};
+  bool bulk_read_{false};
+  std::vector<BulkEntry> bulk_entries_;
   std::vector<Joint> joints_;
   std::vector<Joint> virtual_joints_;
   std::vector<uint8_t> joint_ids_;
-  uint8_t gripper_id_{255};
-  float gripper_current_limit_{200.0f};
+  std::array<int, 256> joint_index_by_id_{};
+  RegisterLayout layout_;
+  std::vector<double> item_states_;
+  std::vector<uint8_t> write_params_;
+  std::vector<ValueScale> scales_;
+  // every joint for decoding the reads, and the arm joints for the sync writes
+  std::vector<JointGroup> read_groups_;
+  std::vector<JointGroup> arm_groups_;
+  // arm joints put in extended position mode for position control
+  std::vector<bool> extended_position_;
+  std::vector<MultiTurnPosition> multi_turn_;
+  std::vector<int32_t> current_limits_;
+  std::vector<int32_t> pwm_limits_;
+  bool combined_write_{false};
+  bool profile_interpolation_{false};
+  double profile_acceleration_ratio_{0.25};
+  std::vector<double> profile_goals_;
+  std::vector<double> profile_currents_;
+  std::chrono::steady_clock::time_point profile_goal_time_{};
+  std::vector<uint8_t> read_data_;
+  std::vector<uint8_t> read_params_;
+  std::vector<bool> read_received_;
+  std::vector<uint32_t> read_failures_;
+  // consecutive failed read cycles that evict a servo from the sync groups, 0 for never
+  uint32_t evict_after_{0};
+  std::vector<bool> evicted_;
+  std::size_t evicted_count_{0};
+  std::chrono::milliseconds probe_period_{1000};
+  std::chrono::steady_clock::time_point probe_time_{};
+  // the evicted joint read along in this cycle, -1 for none
+  int probe_index_{-1};
+  std::size_t probe_cursor_{0};
+  std::chrono::microseconds read_budget_{2000};
+  std::chrono::milliseconds stats_period_{0};
+  std::chrono::steady_clock::time_point stats_start_{};
+  uint64_t stats_bytes_{0};
+  uint64_t stats_writes_{0};
+  uint64_t stats_samples_{0};
+  double stats_error_sq_{0.0};
+  double stats_error_max_{0.0};
+  StateSnapshot state_snapshot_;
+  BusRecorder recorder_;
+  BusReplay replay_;
+  bool replay_realtime_{true};
+  // the arm joints and the end-effectors, which are written in separate sync writes
+  std::vector<std::size_t> arm_indices_;
+  std::vector<uint8_t> arm_ids_;
+  std::vector<std::size_t> gripper_indices_;
+  std::vector<uint8_t> gripper_ids_;
+  RegisterLayout gripper_layout_;
+  std::vector<uint8_t> gripper_params_;
+  std::chrono::steady_clock::duration gripper_period_{0};
+  std::chrono::steady_clock::time_point gripper_write_time_{};
   bool torque_enabled_{false};
   ControlMode control_mode_{ControlMode::Position};
-  ControlMode gripper_control_mode_{ControlMode::CurrentBasedPosition};
   bool use_dummy_{false};
+  bool streaming_{false};
+  std::chrono::microseconds stream_delay_{20000};
+  SetpointQueue setpoint_queue_;
+  // the joints and state items the controllers see while streaming
+  std::vector<Joint> stream_joints_;
+  std::vector<double> stream_item_states_;
+  std::vector<double> stream_setpoint_;
+  std::vector<double> stream_sample_;
+  std::mutex stream_mutex_;
+  std::vector<JointValue> stream_states_;
+  std::vector<double> stream_published_items_;
+  std::vector<JointDiagnostics> stream_diagnostics_;
+  std::vector<JointDiagnostics> stream_published_diagnostics_;
+  // set by the bus thread after a mode switch for read() to reset the commands
+  std::atomic<bool> stream_reset_{false};
+  std::function<void()> stream_job_;
+  double queue_depth_{0.0};
+  double queue_underruns_{0.0};
+  double bus_overruns_{0.0};
+  // last so that it stops before the bus it runs on is torn down
+  BusThread bus_thread_;
 };
 }  // namespace dynamixel_hardware
 
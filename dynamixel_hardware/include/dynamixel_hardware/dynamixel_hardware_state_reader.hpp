@@ -23,9 +23,12 @@
 #include <hardware_interface/system_interface.hpp>
 #include <hardware_interface/types/hardware_interface_return_values.hpp>
 #include <hardware_interface/types/hardware_interface_status_values.hpp>
-#include <map>
+#include <chrono>
+#include <string>
 #include <vector>
 
+#include "dynamixel_hardware/register_layout.hpp"
+#include "dynamixel_hardware/state_snapshot.hpp"
 #include "dynamixel_hardware/visiblity_control.h"
 #include "rclcpp/macros.hpp"
 
@@ -91,13 +94,30 @@ private:
 
   return_type reset_command();
 
+  // Maps the state snapshot of the DynamixelHardware and matches its joints by id.
+  bool attach_snapshot();
+
+  return_type read_snapshot();
+
+  // Sets the states to NaN while the snapshot is not updated.
+  void mark_stale();
+
   DynamixelWorkbench dynamixel_workbench_;
-  std::map<const char * const, const ControlItem *> control_items_;
+  RegisterLayout layout_;
   std::vector<Joint> joints_;
   std::vector<uint8_t> joint_ids_;
   bool torque_enabled_{false};
   ControlMode control_mode_{ControlMode::Position};
   bool use_dummy_{false};
+  std::string snapshot_name_;
+  StateSnapshot snapshot_;
+  std::vector<SnapshotJoint> snapshot_joints_;
+  std::vector<int> snapshot_index_;
+  std::chrono::steady_clock::time_point snapshot_attach_time_{};
+  // age of the latest cycle after which the state is stale
+  std::chrono::nanoseconds snapshot_timeout_{std::chrono::milliseconds(200)};
+  std::chrono::steady_clock::time_point snapshot_check_time_{};
+  bool snapshot_stale_{true};
 };
 }  // namespace dynamixel_hardware_state_reader
 
@@ -0,0 +1,90 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__PROTOCOL1_HPP_
+#define DYNAMIXEL_HARDWARE__PROTOCOL1_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "dynamixel_hardware/protocol2.hpp"
+
+namespace dynamixel_hardware
+{
+// header(2) id(1) length(1) instruction or error(1) checksum(1) around the parameters
+constexpr std::size_t kProtocol1PacketOverhead = 6;
+// the length byte counts the instruction and the checksum too
+constexpr std::size_t kProtocol1MaxParams = 253;
+
+// Builds the Protocol 1.0 instruction packets of the bus cycle and parses the status packets
+// coming back, like Protocol2 does for Protocol 2.0. Protocol 1.0 has no Sync Read, and only
+// the MX series answers its Bulk Read. The packets have no byte stuffing and end with a one
+// byte checksum instead of a CRC.
+class Protocol1
+{
+public:
+  Protocol1();
+
+  // Makes room for instruction packets of up to tx_params and status packets of up to
+  // rx_params parameter bytes. The buffers grow only.
+  void reserve(const std::size_t tx_params, const std::size_t rx_params);
+
+  // Each builds an instruction packet in tx() and returns its size, 0 when the parameters do
+  // not fit in a packet.
+  std::size_t read(const uint8_t id, const uint8_t address, const uint8_t length);
+  std::size_t write(
+    const uint8_t id, const uint8_t address, const uint8_t * data, const uint8_t length);
+
+  // The servos answer in the order of the entries, each after the status packet of the one
+  // before it.
+  std::size_t bulk_read(const BulkEntry * entries, const std::size_t count);
+
+  // params holds count entries of an id followed by length data bytes.
+  std::size_t sync_write(
+    const uint8_t address, const uint8_t length, const uint8_t * params,
+    const std::size_t count);
+
+  const uint8_t * tx() const { return tx_.data(); }
+
+  // Drops every received byte.
+  void clear_rx();
+
+  // Free room at the end of the receive buffer to read into, followed by received() with the
+  // number of bytes read.
+  uint8_t * rx_space(std::size_t & available);
+  void received(const std::size_t count);
+
+  // Takes the next complete status packet out of the received bytes. Corrupt packets and noise
+  // are skipped and counted. Returns false when no complete packet is buffered.
+  bool next_status(StatusPacket & status);
+
+  uint64_t corrupt_packets() const { return corrupt_packets_; }
+
+private:
+  void reserve_tx(const std::size_t params);
+
+  // Fills in the id, length and instruction of the parameters written from kParamIndex on and
+  // the checksum.
+  std::size_t finish(const uint8_t id, const uint8_t instruction, const std::size_t params);
+
+  std::vector<uint8_t> tx_;
+  std::vector<uint8_t> rx_;
+  std::size_t rx_begin_{0};
+  std::size_t rx_end_{0};
+  uint64_t corrupt_packets_{0};
+};
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__PROTOCOL1_HPP_
@@ -0,0 +1,123 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__PROTOCOL2_HPP_
+#define DYNAMIXEL_HARDWARE__PROTOCOL2_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dynamixel_hardware
+{
+constexpr uint8_t kBroadcastId = 0xfe;
+constexpr uint8_t kInstructionRead = 0x02;
+constexpr uint8_t kInstructionWrite = 0x03;
+constexpr uint8_t kInstructionStatus = 0x55;
+constexpr uint8_t kInstructionSyncRead = 0x82;
+constexpr uint8_t kInstructionSyncWrite = 0x83;
+constexpr uint8_t kInstructionFastSyncRead = 0x8a;
+constexpr uint8_t kInstructionBulkRead = 0x92;
+constexpr uint8_t kInstructionBulkWrite = 0x93;
+
+// CRC-16 of Protocol 2.0 (polynomial 0x8005), continued from crc.
+uint16_t update_crc(uint16_t crc, const uint8_t * data, const std::size_t length);
+
+struct BulkEntry
+{
+  uint8_t id;
+  uint16_t address;
+  uint16_t length;
+};
+
+// A status packet in the receive buffer, valid until the next call to Protocol2.
+struct StatusPacket
+{
+  uint8_t id;
+  uint8_t error;
+  // after the error byte, with the byte stuffing removed
+  const uint8_t * params;
+  uint16_t length;
+};
+
+// Builds the Protocol 2.0 instruction packets of the bus cycle and parses the status packets
+// coming back, in buffers allocated once by reserve(). The packet header is written once and
+// only the instruction, parameters, byte stuffing and CRC are filled in per packet.
+class Protocol2
+{
+public:
+  Protocol2();
+
+  // Makes room for instruction packets of up to tx_params and status packets of up to
+  // rx_params parameter bytes. The buffers grow only.
+  void reserve(const std::size_t tx_params, const std::size_t rx_params);
+
+  // Each builds an instruction packet for one servo in tx() and returns its size.
+  std::size_t read(const uint8_t id, const uint16_t address, const uint16_t length);
+  std::size_t write(
+    const uint8_t id, const uint16_t address, const uint8_t * data, const uint16_t length);
+
+  // Each builds a broadcast instruction packet in tx() and returns its size.
+  std::size_t sync_read(
+    const uint16_t address, const uint16_t length, const uint8_t * ids, const std::size_t count,
+    const bool fast = false);
+
+  // params holds count entries of an id followed by length data bytes.
+  std::size_t sync_write(
+    const uint16_t address, const uint16_t length, const uint8_t * params,
+    const std::size_t count);
+
+  std::size_t bulk_read(const BulkEntry * entries, const std::size_t count);
+
+  // data holds the data bytes of the entries back to back.
+  std::size_t bulk_write(const BulkEntry * entries, const uint8_t * data, const std::size_t count);
+
+  const uint8_t * tx() const { return tx_.data(); }
+
+  // Drops every received byte.
+  void clear_rx();
+
+  // Free room at the end of the receive buffer to read into, followed by received() with the
+  // number of bytes read.
+  uint8_t * rx_space(std::size_t & available);
+  void received(const std::size_t count);
+
+  // Takes the next complete status packet out of the received bytes. Corrupt packets and noise
+  // are skipped and counted. Returns false when no complete packet is buffered.
+  bool next_status(StatusPacket & status);
+
+  // Number of entries of a Fast Sync Read status of length data bytes each, and entry k of
+  // them as error, id and the data bytes.
+  static std::size_t fast_sync_count(const StatusPacket & status, const uint16_t length);
+  static const uint8_t * fast_sync_entry(
+    const StatusPacket & status, const uint16_t length, const std::size_t k);
+
+  uint64_t corrupt_packets() const { return corrupt_packets_; }
+
+private:
+  void reserve_tx(const std::size_t params);
+
+  // Stuffs the parameters written from kParamIndex on and finishes the packet.
+  std::size_t finish(
+    const uint8_t instruction, std::size_t params, const uint8_t id = kBroadcastId);
+
+  std::vector<uint8_t> tx_;
+  std::vector<uint8_t> rx_;
+  std::size_t rx_begin_{0};
+  std::size_t rx_end_{0};
+  uint64_t corrupt_packets_{0};
+};
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__PROTOCOL2_HPP_
@@ -0,0 +1,210 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__REGISTER_LAYOUT_HPP_
+#define DYNAMIXEL_HARDWARE__REGISTER_LAYOUT_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dynamixel_hardware
+{
+// A control table item at its direct address, and at its byte offset in the sync read or sync
+// write block carrying it. A zero length item is not available on the servos.
+struct RegisterItem
+{
+  std::string name{};
+  uint16_t address{0};
+  uint8_t length{0};
+  uint16_t offset{0};
+};
+
+// Registers of one bus, compiled once by configure() so that read() and write() only use
+// precomputed addresses, lengths and offsets.
+struct RegisterLayout
+{
+  // sync read block
+  uint16_t read_address{0};
+  uint16_t read_length{0};
+  RegisterItem present_position{};
+  RegisterItem present_velocity{};
+  RegisterItem present_current{};
+  std::vector<RegisterItem> state_items{};
+
+  // goal registers, and the combined indirect goal block
+  RegisterItem goal_position{};
+  RegisterItem goal_velocity{};
+  uint16_t write_address{0};
+  uint16_t write_length{0};
+  RegisterItem profile_velocity{};
+  RegisterItem profile_acceleration{};
+  RegisterItem goal_current{};
+  RegisterItem goal_pwm{};
+};
+
+// Little endian register value, zero-extended like the workbench's getSyncReadData
+inline int32_t get_value(const uint8_t * data, const uint8_t length)
+{
+  switch (length) {
+    case 1:
+      return data[0];
+    case 2:
+      return static_cast<int32_t>(static_cast<uint16_t>(data[0] | (data[1] << 8)));
+    case 4:
+      return static_cast<int32_t>(
+        static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+        (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24));
+    default:
+      return 0;
+  }
+}
+
+inline void set_value(uint8_t * data, const uint8_t length, const int32_t value)
+{
+  for (uint8_t i = 0; i < length; i++) {
+    data[i] = static_cast<uint32_t>(value) >> (8 * i) & 0xff;
+  }
+}
+
+// Conversions of a servo model between register values and rad, rad/s and mA, computed like the
+// workbench's from its model info once instead of looking the model up on every call.
+struct ValueScale
+{
+  double zero_position{0.0};
+  // rad per value above and below zero_position
+  double max_position_ratio{0.0};
+  double min_position_ratio{0.0};
+  // rad/s per value
+  double velocity_unit{0.0};
+  // mA per value
+  double current_unit{0.0};
+  // Protocol 1.0 speeds and loads carry the direction in bit 10 instead of a sign
+  bool sign_magnitude{false};
+};
+
+inline double to_radian(const ValueScale & scale, const int32_t value)
+{
+  if (value > scale.zero_position) {
+    return (value - scale.zero_position) * scale.max_position_ratio;
+  } else if (value < scale.zero_position) {
+    return (value - scale.zero_position) * scale.min_position_ratio;
+  }
+  return 0.0;
+}
+
+inline int32_t from_radian(const ValueScale & scale, const double radian)
+{
+  if (radian > 0.0) {
+    return static_cast<int32_t>(radian / scale.max_position_ratio + scale.zero_position);
+  } else if (radian < 0.0) {
+    return static_cast<int32_t>(radian / scale.min_position_ratio + scale.zero_position);
+  }
+  return static_cast<int32_t>(scale.zero_position);
+}
+
+// a 10 bit magnitude with the direction in bit 10
+inline int32_t from_sign_magnitude(const int32_t value)
+{
+  return value & 0x400 ? -(value & 0x3ff) : value & 0x3ff;
+}
+
+inline int32_t to_sign_magnitude(const int32_t value)
+{
+  return value < 0 ? 0x400 | std::min(-value, 0x3ff) : std::min(value, 0x3ff);
+}
+
+inline double to_velocity(const ValueScale & scale, const int32_t value)
+{
+  return (scale.sign_magnitude ? from_sign_magnitude(value) : value) * scale.velocity_unit;
+}
+
+inline int32_t from_velocity(const ValueScale & scale, const double velocity)
+{
+  const int32_t value = static_cast<int32_t>(velocity / scale.velocity_unit);
+  return scale.sign_magnitude ? to_sign_magnitude(value) : value;
+}
+
+// Present_Current and Goal_Current are signed 16 bit, Present_Load of Protocol 1.0 in sign and
+// magnitude
+inline double to_current(const ValueScale & scale, const int32_t value)
+{
+  return (scale.sign_magnitude ? from_sign_magnitude(value) : static_cast<int16_t>(value)) *
+         scale.current_unit;
+}
+
+inline int32_t from_current(const ValueScale & scale, const double current)
+{
+  return static_cast<int32_t>(std::round(current / scale.current_unit));
+}
+
+// Present_Position of a joint in extended position mode, followed across the wraparound of its
+// register and across the turns a servo forgets when it restarts or changes its operating mode.
+struct MultiTurnPosition
+{
+  // rad per value and values per turn
+  double ratio{0.0};
+  int32_t turn{0};
+  // the unwrapped position and the last register value, sign-extended
+  int64_t value{0};
+  int32_t raw{0};
+  bool valid{false};
+  // the next register value is only known within a turn of the last one
+  bool rebase{false};
+};
+
+// Moves the position to a Present_Position of length bytes the shorter way around the register,
+// or around a turn when rebasing.
+inline int64_t unwrap(MultiTurnPosition & position, const int32_t raw, const uint8_t length)
+{
+  const int32_t value = length == 2 ? static_cast<int16_t>(raw) : raw;
+  if (!position.valid) {
+    position.value = value;
+    position.valid = true;
+  } else if (position.rebase) {
+    int64_t delta = (static_cast<int64_t>(value) - position.raw) % position.turn;
+    if (delta > position.turn / 2) {
+      delta -= position.turn;
+    } else if (delta < -position.turn / 2) {
+      delta += position.turn;
+    }
+    position.value += delta;
+  } else if (length == 2) {
+    position.value += static_cast<int16_t>(value - position.raw);
+  } else {
+    position.value +=
+      static_cast<int32_t>(static_cast<uint32_t>(value) - static_cast<uint32_t>(position.raw));
+  }
+  position.raw = value;
+  position.rebase = false;
+  return position.value;
+}
+
+inline double to_radian(const ValueScale & scale, const MultiTurnPosition & position)
+{
+  return (position.value - scale.zero_position) * position.ratio;
+}
+
+// Goal_Position in the servo's count of turns
+inline int32_t from_radian(
+  const ValueScale & scale, const MultiTurnPosition & position, const double radian)
+{
+  const int64_t value = std::llround(radian / position.ratio + scale.zero_position);
+  return static_cast<int32_t>(value - (position.value - position.raw));
+}
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__REGISTER_LAYOUT_HPP_
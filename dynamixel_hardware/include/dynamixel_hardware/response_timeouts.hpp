@@ -0,0 +1,94 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__RESPONSE_TIMEOUTS_HPP_
+#define DYNAMIXEL_HARDWARE__RESPONSE_TIMEOUTS_HPP_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace dynamixel_hardware
+{
+enum class Transaction : uint8_t {
+  SyncRead = 0,
+  // a sync read of the servos that did not answer the first one
+  SyncReadRetry = 1,
+  FastSyncRead = 2,
+  // Protocol 1.0
+  BulkRead = 3,
+  Read = 4,
+};
+constexpr std::size_t kTransactionCount = 5;
+
+// Learns how long after an instruction each servo's status packet arrives, per transaction,
+// and derives the timeouts from the distribution, the kQuantile of it plus a margin within
+// configured limits.
+class ResponseTimeouts
+{
+public:
+  using Duration = std::chrono::nanoseconds;
+
+  static constexpr double kQuantile = 0.99;
+  // samples a servo needs before its timeout is used
+  static constexpr uint32_t kWarmupSamples = 50;
+  // misses of the learned timeout in a row after which a servo's response time is learned again
+  static constexpr uint32_t kMissLimit = 3;
+
+  void configure(
+    const std::size_t joints, const Duration min_timeout, const Duration max_timeout,
+    const Duration margin);
+
+  // Forgets everything learned.
+  void reset();
+
+  void add(const Transaction transaction, const std::size_t joint, const Duration round_trip);
+
+  // Counts a status packet that did not arrive within the learned timeout. A servo whose
+  // latency rose past it misses it every time, and after kMissLimit in a row its distribution
+  // is dropped, so that it is waited for up to the computed deadline until learned again.
+  void miss(const Transaction transaction, const std::size_t joint);
+
+  // The learned timeout of a servo, zero until it has enough samples.
+  Duration timeout(const Transaction transaction, const std::size_t joint) const;
+
+private:
+  // 1/8 octave wide bins from kFirstBin on
+  static constexpr std::size_t kBins = 128;
+  static constexpr int64_t kFirstBinNs = 10000;
+  // the counts are halved at this many samples, so that the distribution follows changes
+  static constexpr uint32_t kWindow = 2000;
+
+  struct Histogram
+  {
+    std::array<uint32_t, kBins> bins{};
+    uint32_t count{0};
+    uint32_t samples{0};
+    uint32_t misses{0};
+    Duration timeout{0};
+  };
+
+  Histogram & histogram(const Transaction transaction, const std::size_t joint);
+
+  void update_timeout(Histogram & histogram) const;
+
+  std::vector<Histogram> histograms_;
+  Duration min_timeout_{0};
+  Duration max_timeout_{0};
+  Duration margin_{0};
+};
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__RESPONSE_TIMEOUTS_HPP_
@@ -0,0 +1,78 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__SERIAL_PORT_HPP_
+#define DYNAMIXEL_HARDWARE__SERIAL_PORT_HPP_
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace dynamixel_hardware
+{
+// start, 8 data and stop bits
+constexpr int64_t kBitsPerByte = 10;
+
+// A raw, non-blocking serial port whose reads sleep in ppoll() until bytes arrive or a
+// deadline passes, instead of polling the port in a loop.
+class SerialPort
+{
+public:
+  ~SerialPort();
+
+  // Opens path at any baud rate, 8N1 without flow control.
+  bool open(const std::string & path, const int baud_rate, std::string & error);
+
+  void close();
+
+  bool is_open() const { return fd_ >= 0; }
+
+  // Whether the device went away, e.g. a USB adapter was unplugged, since it was opened.
+  bool lost() const { return lost_; }
+
+  int baud_rate() const { return baud_rate_; }
+
+  // Drops the bytes received and not read yet.
+  void flush_input();
+
+  // Writes all of data, waiting for room in the transmit buffer until deadline.
+  bool write(
+    const uint8_t * data, const std::size_t size,
+    const std::chrono::steady_clock::time_point deadline);
+
+  // Reads up to size bytes that arrived, waiting for the first until deadline. Returns the
+  // number of bytes read, 0 once the deadline passed, or -1 on an error of the port.
+  ssize_t read(
+    uint8_t * data, const std::size_t size, const std::chrono::steady_clock::time_point deadline);
+
+  // Time size bytes take on the line.
+  std::chrono::nanoseconds transfer_time(const std::size_t size) const;
+
+private:
+  // Waits for events on the port until deadline. Returns false once it passed. A hang-up or an
+  // error of the device marks the port lost.
+  bool wait(const short events, const std::chrono::steady_clock::time_point deadline);
+
+  int fd_{-1};
+  int baud_rate_{0};
+  // read across the hand-over of the port to the reconnect thread
+  std::atomic<bool> lost_{false};
+};
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__SERIAL_PORT_HPP_
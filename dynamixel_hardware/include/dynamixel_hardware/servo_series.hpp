@@ -0,0 +1,256 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__SERVO_SERIES_HPP_
+#define DYNAMIXEL_HARDWARE__SERVO_SERIES_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "dynamixel_hardware/register_layout.hpp"
+
+namespace dynamixel_hardware
+{
+// rad/s per rpm, as the workbench converts
+constexpr double kRpmToRadPerSecond = 0.104719755;
+
+// Units and registers of a servo series. The units are computed like make_value_scale() does
+// from the workbench's single precision model info, so that they compare equal to it.
+struct XSeries
+{
+  static constexpr const char * kName = "X";
+  static constexpr int32_t kZeroPosition = 2048;
+  // rad per value above and below kZeroPosition
+  static constexpr double kMaxPositionRatio = 3.14159265f / (4095 - 2048);
+  static constexpr double kMinPositionRatio = -3.14159265f / (0 - 2048);
+  static constexpr double kVelocityUnit = static_cast<double>(0.229f) * kRpmToRadPerSecond;
+  static constexpr double kCurrentUnit = 10000 * 2.69f / 10000.0;
+  // Present_Speed and Present_Load carry the direction in bit 10 instead of a sign
+  static constexpr bool kSignMagnitude = false;
+  static constexpr uint16_t kPresentPositionAddress = 132;
+  static constexpr uint8_t kPresentPositionLength = 4;
+  static constexpr uint16_t kPresentVelocityAddress = 128;
+  static constexpr uint8_t kPresentVelocityLength = 4;
+  static constexpr uint16_t kPresentCurrentAddress = 126;
+  static constexpr uint8_t kPresentCurrentLength = 2;
+  static constexpr uint8_t kGoalPositionLength = 4;
+  static constexpr uint8_t kGoalVelocityLength = 4;
+  static constexpr uint8_t kGoalCurrentLength = 2;
+};
+
+// MX-64 and MX-106 with Protocol 2.0, the X series control table with another current unit
+struct MX2Series : XSeries
+{
+  static constexpr const char * kName = "MX(2.0)";
+  static constexpr double kCurrentUnit = 10000 * 3.36f / 10000.0;
+};
+
+// MX series with Protocol 1.0, Present_Load instead of a current
+struct MX1Series
+{
+  static constexpr const char * kName = "MX(1.0)";
+  static constexpr int32_t kZeroPosition = 2048;
+  static constexpr double kMaxPositionRatio = 3.14159265f / (4095 - 2048);
+  static constexpr double kMinPositionRatio = -3.14159265f / (0 - 2048);
+  static constexpr double kVelocityUnit = static_cast<double>(0.114f) * kRpmToRadPerSecond;
+  static constexpr double kCurrentUnit = static_cast<double>(2.69f);
+  static constexpr bool kSignMagnitude = true;
+  static constexpr uint16_t kPresentPositionAddress = 36;
+  static constexpr uint8_t kPresentPositionLength = 2;
+  static constexpr uint16_t kPresentVelocityAddress = 38;
+  static constexpr uint8_t kPresentVelocityLength = 2;
+  static constexpr uint16_t kPresentCurrentAddress = 40;
+  static constexpr uint8_t kPresentCurrentLength = 2;
+  static constexpr uint8_t kGoalPositionLength = 2;
+  static constexpr uint8_t kGoalVelocityLength = 2;
+  static constexpr uint8_t kGoalCurrentLength = 0;
+};
+
+// AX series, 300 degrees over 1024 values
+struct AXSeries : MX1Series
+{
+  static constexpr const char * kName = "AX";
+  static constexpr int32_t kZeroPosition = 512;
+  static constexpr double kMaxPositionRatio = 2.61799f / (1023 - 512);
+  static constexpr double kMinPositionRatio = -2.61799f / (0 - 512);
+  static constexpr double kVelocityUnit = static_cast<double>(0.111f) * kRpmToRadPerSecond;
+};
+
+// Conversions and read block decoding of a series with its units and register lengths as
+// compile-time constants. Indirect selects the read block configure_read_block() maps through
+// the Indirect Address table, position, velocity and current back to back, and otherwise the
+// direct span of the three.
+template<typename Series, bool Indirect>
+struct SeriesCodec
+{
+  static constexpr const char * kName = Series::kName;
+  static constexpr uint16_t kFirstAddress = std::min(
+    {Series::kPresentPositionAddress, Series::kPresentVelocityAddress,
+     Series::kPresentCurrentAddress});
+  static constexpr uint16_t kPositionOffset =
+    Indirect ? 0 : Series::kPresentPositionAddress - kFirstAddress;
+  static constexpr uint16_t kVelocityOffset =
+    Indirect ? Series::kPresentPositionLength
+             : Series::kPresentVelocityAddress - kFirstAddress;
+  static constexpr uint16_t kCurrentOffset =
+    Indirect ? Series::kPresentPositionLength + Series::kPresentVelocityLength
+             : Series::kPresentCurrentAddress - kFirstAddress;
+
+  // Whether the layout, the units and the sign encoding of a servo are this series'. Only then
+  // do its kernels give the values GenericCodec gives for the servo.
+  static bool matches(const RegisterLayout & layout, const ValueScale & scale)
+  {
+    const auto item_is =
+      [](const RegisterItem & item, const uint16_t offset, const uint8_t length) {
+        return item.offset == offset && item.length == length;
+      };
+    const auto equal = [](const double a, const double b) {
+      return std::abs(a - b) <= 1e-9 * std::abs(b);
+    };
+    return item_is(layout.present_position, kPositionOffset, Series::kPresentPositionLength) &&
+           item_is(layout.present_velocity, kVelocityOffset, Series::kPresentVelocityLength) &&
+           item_is(layout.present_current, kCurrentOffset, Series::kPresentCurrentLength) &&
+           layout.goal_position.length == Series::kGoalPositionLength &&
+           layout.goal_velocity.length == Series::kGoalVelocityLength &&
+           layout.goal_current.length == Series::kGoalCurrentLength &&
+           scale.zero_position == Series::kZeroPosition &&
+           equal(scale.max_position_ratio, Series::kMaxPositionRatio) &&
+           equal(scale.min_position_ratio, Series::kMinPositionRatio) &&
+           equal(scale.velocity_unit, Series::kVelocityUnit) &&
+           equal(scale.current_unit, Series::kCurrentUnit) &&
+           scale.sign_magnitude == Series::kSignMagnitude;
+  }
+
+  static double to_radian(const int32_t value)
+  {
+    if (value > Series::kZeroPosition) {
+      return (value - Series::kZeroPosition) * Series::kMaxPositionRatio;
+    } else if (value < Series::kZeroPosition) {
+      return (value - Series::kZeroPosition) * Series::kMinPositionRatio;
+    }
+    return 0.0;
+  }
+
+  static int32_t from_radian(const double radian)
+  {
+    if (radian > 0.0) {
+      return static_cast<int32_t>(radian / Series::kMaxPositionRatio + Series::kZeroPosition);
+    } else if (radian < 0.0) {
+      return static_cast<int32_t>(radian / Series::kMinPositionRatio + Series::kZeroPosition);
+    }
+    return Series::kZeroPosition;
+  }
+
+  // sign and magnitude, or a two's complement of the item length
+  static int32_t signed_value(const int32_t value, const uint8_t length)
+  {
+    if (Series::kSignMagnitude) {
+      return from_sign_magnitude(value);
+    }
+    return length == 2 ? static_cast<int16_t>(value) : value;
+  }
+
+  static int32_t unsigned_value(const int32_t value)
+  {
+    return Series::kSignMagnitude ? to_sign_magnitude(value) : value;
+  }
+
+  static void decode(
+    const uint8_t * data, const RegisterLayout &, const ValueScale &, double & position,
+    double & velocity, double & effort)
+  {
+    position = to_radian(get_value(data + kPositionOffset, Series::kPresentPositionLength));
+    velocity =
+      signed_value(
+        get_value(data + kVelocityOffset, Series::kPresentVelocityLength),
+        Series::kPresentVelocityLength) *
+      Series::kVelocityUnit;
+    effort =
+      signed_value(
+        get_value(data + kCurrentOffset, Series::kPresentCurrentLength),
+        Series::kPresentCurrentLength) *
+      Series::kCurrentUnit;
+  }
+
+  static void encode_position(
+    uint8_t * data, const RegisterLayout &, const ValueScale &, const double position)
+  {
+    set_value(data, Series::kGoalPositionLength, from_radian(position));
+  }
+
+  static void encode_velocity(
+    uint8_t * data, const RegisterLayout &, const ValueScale &, const double velocity)
+  {
+    set_value(
+      data, Series::kGoalVelocityLength,
+      unsigned_value(static_cast<int32_t>(velocity / Series::kVelocityUnit)));
+  }
+
+  static void encode_current(
+    uint8_t * data, const RegisterLayout &, const ValueScale &, const double current,
+    const int32_t limit)
+  {
+    const int32_t value = static_cast<int32_t>(std::round(current / Series::kCurrentUnit));
+    set_value(data, Series::kGoalCurrentLength, std::max(-limit, std::min(limit, value)));
+  }
+};
+
+// The conversions of any model from its layout and units at run time
+struct GenericCodec
+{
+  static constexpr const char * kName = "generic";
+
+  static bool matches(const RegisterLayout &, const ValueScale &) { return true; }
+
+  static void decode(
+    const uint8_t * data, const RegisterLayout & layout, const ValueScale & scale,
+    double & position, double & velocity, double & effort)
+  {
+    const RegisterItem & present_position = layout.present_position;
+    const RegisterItem & present_velocity = layout.present_velocity;
+    const RegisterItem & present_current = layout.present_current;
+    position = to_radian(
+      scale, get_value(data + present_position.offset, present_position.length));
+    velocity = to_velocity(
+      scale, get_value(data + present_velocity.offset, present_velocity.length));
+    effort =
+      to_current(scale, get_value(data + present_current.offset, present_current.length));
+  }
+
+  static void encode_position(
+    uint8_t * data, const RegisterLayout & layout, const ValueScale & scale,
+    const double position)
+  {
+    set_value(data, layout.goal_position.length, from_radian(scale, position));
+  }
+
+  static void encode_velocity(
+    uint8_t * data, const RegisterLayout & layout, const ValueScale & scale,
+    const double velocity)
+  {
+    set_value(data, layout.goal_velocity.length, from_velocity(scale, velocity));
+  }
+
+  static void encode_current(
+    uint8_t * data, const RegisterLayout & layout, const ValueScale & scale, const double current,
+    const int32_t limit)
+  {
+    const int32_t value = from_current(scale, current);
+    set_value(data, layout.goal_current.length, std::max(-limit, std::min(limit, value)));
+  }
+};
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__SERVO_SERIES_HPP_
@@ -0,0 +1,62 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__SETPOINT_QUEUE_HPP_
+#define DYNAMIXEL_HARDWARE__SETPOINT_QUEUE_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace dynamixel_hardware
+{
+// Fixed capacity queue of timestamped setpoints, pushed at the controller rate and sampled
+// with linear interpolation at the bus rate. Each setpoint is a row of width values.
+class SetpointQueue
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  void configure(const std::size_t width, const std::size_t capacity);
+
+  void clear();
+
+  // Appends a setpoint, dropping the oldest one when the queue is full.
+  void push(const Clock::time_point time, const double * values);
+
+  // Interpolates the setpoints at time into values and drops the ones before it.
+  // Holds the newest setpoint and counts an underrun when time is past it.
+  // Returns false when the queue is empty and values were left untouched.
+  bool sample(const Clock::time_point time, double * values);
+
+  std::size_t depth();
+
+  uint64_t underruns();
+
+private:
+  const double * row(const std::size_t index) const;
+
+  std::mutex mutex_;
+  std::size_t width_{0};
+  std::size_t capacity_{0};
+  std::size_t head_{0};
+  std::size_t size_{0};
+  uint64_t underruns_{0};
+  std::vector<Clock::time_point> times_;
+  std::vector<double> values_;
+};
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__SETPOINT_QUEUE_HPP_
@@ -0,0 +1,133 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DYNAMIXEL_HARDWARE__STATE_SNAPSHOT_HPP_
+#define DYNAMIXEL_HARDWARE__STATE_SNAPSHOT_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace dynamixel_hardware
+{
+constexpr uint32_t kSnapshotMagic = 0x534c5844;  // "DXLS"
+constexpr uint32_t kSnapshotVersion = 1;
+constexpr std::size_t kSnapshotNameCapacity = 32;
+constexpr std::size_t kSnapshotRawCapacity = 64;
+
+// Layout of the POSIX shared memory segment the state of every read cycle is published to.
+// The segment holds a SnapshotHeader followed by joint_count SnapshotJoint records, in host
+// byte order. Readers check magic, version, header_size and joint_size before use.
+//
+// Seqlock: the writer makes sequence odd before and even again after it updates the segment.
+// A reader copies the records while sequence is even and retries when it changed meanwhile.
+struct SnapshotHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t joint_size;
+  uint32_t joint_count;
+  // bytes of each joint's raw read block, and where the present items lie in it
+  uint32_t raw_length;
+  uint8_t position_offset;
+  uint8_t position_length;
+  uint8_t velocity_offset;
+  uint8_t velocity_length;
+  uint8_t current_offset;
+  uint8_t current_length;
+  uint8_t reserved[2];
+  std::atomic<uint64_t> sequence;
+  // read cycles since configure
+  uint64_t cycle;
+  // cycles in which at least one servo did not answer
+  uint64_t failed_cycles;
+  // steady and system clock at the end of the cycle
+  int64_t monotonic_ns;
+  int64_t realtime_ns;
+  // time the cycle spent on the bus
+  int64_t read_duration_ns;
+};
+
+struct SnapshotJoint
+{
+  char name[kSnapshotNameCapacity];
+  uint32_t id;
+  // consecutive cycles without a status packet, the state is the last good one meanwhile
+  uint32_t failures;
+  uint64_t total_failures;
+  // rad, rad/s and mA, as exported to ros2_control
+  double position;
+  double velocity;
+  double effort;
+  // read block as received, little-endian items
+  uint8_t raw[kSnapshotRawCapacity];
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "sequence must be plain 64 bit");
+static_assert(offsetof(SnapshotHeader, sequence) == 32, "SnapshotHeader layout changed");
+static_assert(sizeof(SnapshotHeader) == 80, "SnapshotHeader layout changed");
+static_assert(sizeof(SnapshotJoint) == 136, "SnapshotJoint layout changed");
+
+// Shared memory segment holding a state snapshot, created by the hardware and attached to
+// read-only by local readers.
+class StateSnapshot
+{
+public:
+  ~StateSnapshot();
+
+  // Creates the segment name (e.g. "/dynamixel_state") for joint_count joints. A segment left
+  // under that name is unlinked first, so that readers still mapping it are not overwritten.
+  // Readers cannot attach until publish().
+  bool create(const std::string & name, const uint32_t joint_count, std::string & error);
+
+  // Sets magic once the caller filled in the header fields and the joint records.
+  void publish();
+
+  // Maps an existing segment read-only.
+  bool attach(const std::string & name, std::string & error);
+
+  // Whether the name of an attached segment was unlinked or now names another segment, as when
+  // the hardware is configured again.
+  bool replaced() const;
+
+  void close();
+
+  bool is_open() const { return header_ != nullptr; }
+
+  SnapshotHeader * header() { return header_; }
+
+  SnapshotJoint * joints() { return joints_; }
+
+  // Writer side of the seqlock around updating the records.
+  void begin_write();
+  void end_write();
+
+  // Copies a consistent header and joint_count records. Returns false when the writer kept
+  // the segment busy for every try.
+  bool load(SnapshotHeader & header, SnapshotJoint * joints, const uint32_t joint_count) const;
+
+private:
+  std::string name_;
+  bool owner_{false};
+  std::size_t size_{0};
+  // of the mapped segment, to tell it from a new one under the same name
+  uint64_t inode_{0};
+  SnapshotHeader * header_{nullptr};
+  SnapshotJoint * joints_{nullptr};
+};
+}  // namespace dynamixel_hardware
+
+#endif  // DYNAMIXEL_HARDWARE__STATE_SNAPSHOT_HPP_
@@ -0,0 +1,118 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamixel_hardware/bus_recorder.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+namespace dynamixel_hardware
+{
+BusRecorder::~BusRecorder() { close(); }
+
+bool BusRecorder::open(const std::string & path, const uint64_t capacity, std::string & error)
+{
+  close();
+  const int fd = ::open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    error = "open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  const std::size_t size = sizeof(RecordFileHeader) + capacity * sizeof(BusRecord);
+  // allocate the blocks up front so that appending never waits on the file system
+  const int result = posix_fallocate(fd, 0, size);
+  if (result != 0) {
+    error = "fallocate " + path + ": " + std::strerror(result);
+    ::close(fd);
+    return false;
+  }
+  void * memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (memory == MAP_FAILED) {
+    error = "mmap " + path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  // touch every page now instead of faulting them in from the bus cycle
+  std::memset(memory, 0, size);
+  size_ = size;
+  header_ = static_cast<RecordFileHeader *>(memory);
+  records_ =
+    reinterpret_cast<BusRecord *>(static_cast<uint8_t *>(memory) + sizeof(RecordFileHeader));
+  header_->magic = kRecordMagic;
+  header_->version = kRecordVersion;
+  header_->header_size = sizeof(RecordFileHeader);
+  header_->record_size = sizeof(BusRecord);
+  header_->capacity = capacity;
+  return true;
+}
+
+void BusRecorder::close()
+{
+  if (header_ == nullptr) {
+    return;
+  }
+  msync(header_, size_, MS_ASYNC);
+  munmap(header_, size_);
+  header_ = nullptr;
+  records_ = nullptr;
+  size_ = 0;
+}
+
+void BusRecorder::append(
+  const RecordKind kind, const uint16_t address, const uint16_t length, const uint8_t * params,
+  const std::size_t count)
+{
+  BusRecord & record = begin(kind, address, length);
+  record.count = std::min(count, capacity_for(length));
+  std::copy_n(params, record.count * (1 + length), record.payload);
+  commit(record);
+}
+
+BusRecord & BusRecorder::begin(const RecordKind kind, const uint16_t address, const uint16_t length)
+{
+  const uint64_t index = header_->next.load(std::memory_order_relaxed);
+  BusRecord & record = records_[index % header_->capacity];
+  // a slot being rewritten does not belong to any record
+  record.index.store(~0ull, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  record.monotonic_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+  record.kind = kind;
+  record.count = 0;
+  record.address = address;
+  record.length = length;
+  return record;
+}
+
+void BusRecorder::commit(BusRecord & record)
+{
+  const uint64_t index = header_->next.load(std::memory_order_relaxed);
+  record.index.store(index, std::memory_order_release);
+  header_->next.store(index + 1, std::memory_order_release);
+}
+
+std::size_t BusRecorder::capacity_for(const uint16_t length)
+{
+  return std::min<std::size_t>(sizeof(BusRecord::payload) / (1 + length), 255);
+}
+}  // namespace dynamixel_hardware
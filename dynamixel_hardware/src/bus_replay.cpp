@@ -0,0 +1,173 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamixel_hardware/bus_replay.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace dynamixel_hardware
+{
+BusReplay::~BusReplay() { close(); }
+
+bool BusReplay::open(const std::string & path, std::string & error)
+{
+  close();
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error = "open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat status;
+  if (
+    fstat(fd, &status) != 0 ||
+    static_cast<std::size_t>(status.st_size) < sizeof(RecordFileHeader)) {
+    error = path + " is not a bus recording";
+    ::close(fd);
+    return false;
+  }
+  const std::size_t size = status.st_size;
+  void * memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (memory == MAP_FAILED) {
+    error = "mmap " + path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  const auto header = static_cast<const RecordFileHeader *>(memory);
+  if (
+    header->magic != kRecordMagic || header->version != kRecordVersion ||
+    header->header_size != sizeof(RecordFileHeader) || header->record_size != sizeof(BusRecord) ||
+    size < sizeof(RecordFileHeader) + header->capacity * sizeof(BusRecord)) {
+    error = path + " has an unknown recording format";
+    munmap(memory, size);
+    return false;
+  }
+
+  size_ = size;
+  header_ = header;
+  records_ = reinterpret_cast<const BusRecord *>(
+    static_cast<const uint8_t *>(memory) + sizeof(RecordFileHeader));
+  end_ = header_->next.load(std::memory_order_acquire);
+  // the oldest records of a full ring are overwritten
+  position_ = end_ > header_->capacity ? end_ - header_->capacity : 0;
+  comparing_ = false;
+  first_ns_ = 0;
+  start_ = std::chrono::steady_clock::time_point();
+  reads_ = skipped_reads_ = compared_writes_ = mismatched_writes_ = unrecorded_writes_ = 0;
+  return true;
+}
+
+void BusReplay::close()
+{
+  if (header_ == nullptr) {
+    return;
+  }
+  munmap(const_cast<RecordFileHeader *>(header_), size_);
+  header_ = nullptr;
+  records_ = nullptr;
+  size_ = 0;
+}
+
+const BusRecord * BusReplay::record(const uint64_t index) const
+{
+  const BusRecord & record = records_[index % header_->capacity];
+  return record.index.load(std::memory_order_acquire) == index ? &record : nullptr;
+}
+
+const BusRecord * BusReplay::next_read(const bool realtime)
+{
+  const auto now = std::chrono::steady_clock::now();
+  if (start_.time_since_epoch().count() == 0) {
+    start_ = now;
+  }
+  const int64_t elapsed_ns =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_).count();
+
+  const BusRecord * found = nullptr;
+  uint64_t position = position_;
+  for (; position < end_; position++) {
+    const BusRecord * candidate = record(position);
+    if (candidate == nullptr || candidate->kind != RecordKind::SyncRead) {
+      continue;
+    }
+    if (first_ns_ == 0) {
+      first_ns_ = candidate->monotonic_ns;
+    }
+    if (realtime && candidate->monotonic_ns - first_ns_ > elapsed_ns) {
+      break;
+    }
+    if (found != nullptr) {
+      skipped_reads_++;
+    }
+    found = candidate;
+    position_ = position + 1;
+    if (!realtime) {
+      break;
+    }
+  }
+  if (found == nullptr) {
+    if (position == end_) {
+      position_ = end_;
+    }
+    comparing_ = false;
+    return nullptr;
+  }
+  reads_++;
+  write_position_ = position_;
+  comparing_ = true;
+  return found;
+}
+
+bool BusReplay::compare_write(
+  const uint16_t address, const uint16_t length, const uint8_t * params, const std::size_t count)
+{
+  if (!comparing_) {
+    return true;
+  }
+  for (uint64_t index = write_position_; index < end_; index++) {
+    const BusRecord * recorded = record(index);
+    if (recorded == nullptr) {
+      continue;
+    }
+    if (recorded->kind == RecordKind::SyncRead) {
+      // the writes of the next cycle
+      break;
+    }
+    if (recorded->address != address) {
+      continue;
+    }
+    write_position_ = index + 1;
+    compared_writes_++;
+    // the recorder cuts writes to what fits in a record
+    const std::size_t recorded_count = std::min(count, BusRecorder::capacity_for(length));
+    if (
+      recorded->length != length || recorded->count != recorded_count ||
+      !std::equal(params, params + recorded_count * (1 + length), recorded->payload)) {
+      mismatched_writes_++;
+      return false;
+    }
+    return true;
+  }
+  unrecorded_writes_++;
+  return false;
+}
+}  // namespace dynamixel_hardware
@@ -0,0 +1,213 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamixel_hardware/bus_thread.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace dynamixel_hardware
+{
+// stack the bus thread touches up front so it does not page fault in the loop
+constexpr std::size_t kPrefaultStackSize = 64 * 1024;
+
+namespace
+{
+void add_nanoseconds(timespec & time, const int64_t nanoseconds)
+{
+  time.tv_nsec += nanoseconds;
+  while (time.tv_nsec >= 1000000000) {
+    time.tv_nsec -= 1000000000;
+    time.tv_sec++;
+  }
+}
+
+void prefault_stack()
+{
+  unsigned char stack[kPrefaultStackSize];
+  std::memset(stack, 0, sizeof(stack));
+  // keep the compiler from eliding the writes
+  __asm__ __volatile__("" : : "r"(stack) : "memory");
+}
+}  // namespace
+
+BusThread::~BusThread() { stop(); }
+
+bool BusThread::start(const BusThreadConfig & config, std::string & error)
+{
+  stop();
+  stopping_ = false;
+  periodic_function_ = nullptr;
+  thread_ = std::thread(&BusThread::loop, this);
+
+  bool ok = true;
+  if (config.priority > 0) {
+    sched_param param{};
+    param.sched_priority = config.priority;
+    const int result = pthread_setschedparam(thread_.native_handle(), SCHED_FIFO, &param);
+    if (result != 0) {
+      error += "SCHED_FIFO priority " + std::to_string(config.priority) + ": " +
+               std::strerror(result) + ". ";
+      ok = false;
+    }
+  }
+  if (config.cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(config.cpu, &cpus);
+    const int result = pthread_setaffinity_np(thread_.native_handle(), sizeof(cpus), &cpus);
+    if (result != 0) {
+      error += "CPU " + std::to_string(config.cpu) + ": " + std::strerror(result) + ". ";
+      ok = false;
+    }
+  }
+
+  auto job = []() { prefault_stack(); };
+  run(job);
+  return ok;
+}
+
+void BusThread::stop()
+{
+  if (!thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  condition_.notify_all();
+  thread_.join();
+}
+
+std::string BusThread::describe()
+{
+  std::string description;
+  auto job = [&description]() {
+    int policy = 0;
+    sched_param param{};
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    description = policy == SCHED_FIFO ? "SCHED_FIFO"
+                  : policy == SCHED_RR ? "SCHED_RR"
+                                       : "SCHED_OTHER";
+    description += " priority " + std::to_string(param.sched_priority);
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    description += " on CPU " + std::to_string(sched_getcpu()) + " (" +
+                   std::to_string(CPU_COUNT(&cpus)) + " allowed)";
+  };
+  run(job);
+  return description;
+}
+
+JitterStats BusThread::measure_jitter(const std::chrono::microseconds period, const int iterations)
+{
+  JitterStats stats;
+  timespec next{};
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (int i = 0; i < iterations; i++) {
+    add_nanoseconds(next, period.count() * 1000);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const double latency_us =
+      (now.tv_sec - next.tv_sec) * 1e6 + (now.tv_nsec - next.tv_nsec) / 1e3;
+    stats.mean_us += latency_us / iterations;
+    stats.max_us = std::max(stats.max_us, latency_us);
+  }
+  return stats;
+}
+
+bool BusThread::lock_memory(std::string & error)
+{
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    error = std::string("mlockall: ") + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+void BusThread::run(void (*function)(void *), void * argument)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  function_ = function;
+  argument_ = argument;
+  pending_ = true;
+  condition_.notify_all();
+  condition_.wait(lock, [this]() { return !pending_; });
+}
+
+void BusThread::run_periodic(
+  const std::chrono::microseconds period, void (*function)(void *), void * argument)
+{
+  auto job = [this, period, function, argument]() {
+    period_ = period;
+    periodic_function_ = function;
+    periodic_argument_ = argument;
+  };
+  run(job);
+}
+
+void BusThread::loop()
+{
+  timespec next{};
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    if (periodic_function_ == nullptr) {
+      condition_.wait(lock, [this]() { return pending_ || stopping_; });
+    }
+    if (pending_) {
+      lock.unlock();
+      function_(argument_);
+      lock.lock();
+      pending_ = false;
+      condition_.notify_all();
+      if (periodic_function_ != nullptr && next.tv_sec == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &next);
+      }
+      continue;
+    } else if (stopping_) {
+      return;
+    }
+
+    lock.unlock();
+    add_nanoseconds(next, period_.count() * 1000);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    periodic_function_(periodic_argument_);
+
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timespec deadline = next;
+    add_nanoseconds(deadline, period_.count() * 1000);
+    if (
+      now.tv_sec > deadline.tv_sec ||
+      (now.tv_sec == deadline.tv_sec && now.tv_nsec > deadline.tv_nsec)) {
+      // skip the periods that have passed instead of catching up in a burst
+      overruns_++;
+      next = now;
+    }
+    lock.lock();
+  }
+}
+}  // namespace dynamixel_hardware
@@ -16,8 +16,16 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <limits>
+#include <numeric>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "hardware_interface/types/hardware_interface_return_values.hpp"
@@ -27,18 +35,148 @@
 namespace dynamixel_hardware
 {
 constexpr const char * kDynamixelHardware = "DynamixelHardware";
-constexpr uint8_t kGoalPositionIndex = 0;
-constexpr uint8_t kGoalVelocityIndex = 1;
-constexpr uint8_t kPresentPositionVelocityCurrentIndex = 0;
+constexpr float kDefaultGripperCurrentLimit = 200.0f;
 constexpr const char * kGoalPositionItem = "Goal_Position";
 constexpr const char * kGoalVelocityItem = "Goal_Velocity";
 constexpr const char * kGoalCurrentItem = "Goal_Current";
+constexpr const char * kProfileVelocityItem = "Profile_Velocity";
+constexpr const char * kProfileAccelerationItem = "Profile_Acceleration";
 constexpr const char * kMovingSpeedItem = "Moving_Speed";
 constexpr const char * kPresentPositionItem = "Present_Position";
 constexpr const char * kPresentVelocityItem = "Present_Velocity";
 constexpr const char * kPresentSpeedItem = "Present_Speed";
 constexpr const char * kPresentCurrentItem = "Present_Current";
 constexpr const char * kPresentLoadItem = "Present_Load";
+constexpr const char * kCurrentLimitItem = "Current_Limit";
+constexpr const char * kGoalPwmItem = "Goal_PWM";
+constexpr const char * kPwmLimitItem = "PWM_Limit";
+constexpr const char * kReturnDelayTimeItem = "Return_Delay_Time";
+// Return_Delay_Time unit
+constexpr double kReturnDelayUnitUs = 2.0;
+constexpr int kMaxReturnDelayUs = 508;
+constexpr const char * kStatusReturnLevelItem = "Status_Return_Level";
+constexpr const char * kOperatingModeItem = "Operating_Mode";
+constexpr const char * kTorqueEnableItem = "Torque_Enable";
+// the angle limits of Protocol 1.0 servos select joint, wheel or multi-turn mode
+constexpr const char * kCwAngleLimitItem = "CW_Angle_Limit";
+constexpr const char * kCcwAngleLimitItem = "CCW_Angle_Limit";
+// Operating_Mode of the end-effectors
+constexpr int32_t kCurrentBasedPositionMode = 5;
+// status packets for every instruction, the factory setting
+constexpr int kStatusReturnAll = 2;
+// a servo does not answer while it writes its EEPROM
+constexpr std::chrono::milliseconds kEepromWriteTime{20};
+// sync reads timed before and after tune_servos()
+constexpr int kLatencySamples = 20;
+// assumed for an adapter without a latency_timer, as the SDK does
+constexpr double kUnknownUsbLatencyUs = 16000.0;
+// a servo answering late, on top of the return delay and the USB latency
+constexpr double kResponseSlackUs = 500.0;
+// a sync write waiting for room in the transmit buffer
+constexpr std::chrono::milliseconds kWriteMargin{5};
+// the status packet of a single read or write, outside of the cycle budget
+constexpr std::chrono::milliseconds kRegisterTimeout{50};
+constexpr const char * kIndirectAddress1Item = "Indirect_Address_1";
+constexpr const char * kIndirectData1Item = "Indirect_Data_1";
+constexpr uint16_t kIndirectDataCount = 28;
+constexpr const char * kHwIfProfileVelocity = "profile_velocity";
+constexpr const char * kHwIfProfileAcceleration = "profile_acceleration";
+constexpr const char * kHwIfGoalCurrent = "goal_current";
+constexpr const char * kHwIfPwm = "pwm";
+constexpr const char * kHwIfSetpointQueueDepth = "setpoint_queue_depth";
+constexpr const char * kHwIfSetpointUnderruns = "setpoint_underruns";
+constexpr const char * kHwIfBusOverruns = "bus_overruns";
+constexpr const char * kHwIfResponseTimeout = "response_timeout";
+constexpr const char * kHwIfRetryTimeout = "response_timeout_retry";
+constexpr const char * kHwIfStale = "stale";
+constexpr const char * kHwIfEvicted = "evicted";
+// values per joint in a streamed setpoint: command position, velocity, effort, the profile and
+// the PWM
+constexpr std::size_t kSetpointWidth = 7;
+// Goal_PWM values per % of the full duty cycle, 0.113 % each
+constexpr double kPwmValuePerPercent = 885 / 100.0;
+// Profile_Acceleration unit of 214.577 rev/min^2 in rad/s^2
+constexpr double kProfileAccelerationUnit = 214.577 * 2.0 * M_PI / 3600.0;
+// Protocol 2.0 status packet: header(4) id(1) length(2) instruction(1) error(1) params crc(2)
+constexpr uint16_t kStatusPacketOverhead = 11;
+// Protocol 2.0 sync instruction packet: header(4) id(1) length(2) instruction(1) address(2)
+// data length(2) params crc(2)
+constexpr uint16_t kSyncPacketOverhead = 14;
+// Protocol 1.0 status errors after which the data is not valid: range, checksum, instruction
+constexpr uint8_t kProtocol1CommunicationErrors = 0x58;
+// writes differing from a replayed recording that are logged, the rest are only counted
+constexpr uint64_t kReplayReportedWrites = 10;
+
+// The position and velocity conversions of DynamixelWorkbench for a model, current_unit in mA.
+// Protocol 1.0 servos report speeds and loads in sign and magnitude.
+ValueScale make_value_scale(
+  const ModelInfo & model, const double current_unit, const bool sign_magnitude)
+{
+  ValueScale scale;
+  scale.zero_position = model.value_of_zero_radian_position;
+  scale.max_position_ratio =
+    model.max_radian /
+    (model.value_of_max_radian_position - model.value_of_zero_radian_position);
+  scale.min_position_ratio =
+    model.min_radian /
+    (model.value_of_min_radian_position - model.value_of_zero_radian_position);
+  scale.velocity_unit = model.rpm * kRpmToRadPerSecond;
+  scale.current_unit = current_unit;
+  scale.sign_magnitude = sign_magnitude;
+  return scale;
+}
+
+// Operating_Mode the workbench sets for a control mode on Protocol 2.0 servos, -1 for none
+int32_t operating_mode(const ControlMode mode)
+{
+  switch (mode) {
+    case ControlMode::Currrent:
+      return 0;
+    case ControlMode::Velocity:
+      return 1;
+    case ControlMode::Position:
+      return 3;
+    case ControlMode::ExtendedPosition:
+      return 4;
+    case ControlMode::CurrentBasedPosition:
+      return kCurrentBasedPositionMode;
+    case ControlMode::PWM:
+      return 16;
+    default:
+      return -1;
+  }
+}
+
+// name of a control mode the arm can be switched to, nullptr for the others
+const char * control_mode_name(const ControlMode mode)
+{
+  switch (mode) {
+    case ControlMode::Position:
+      return "Position";
+    case ControlMode::Velocity:
+      return "Velocity";
+    case ControlMode::Currrent:
+      return "Current";
+    case ControlMode::PWM:
+      return "PWM";
+    default:
+      return nullptr;
+  }
+}
+
+DynamixelHardware::~DynamixelHardware()
+{
+  // the bus thread would start another reconnect
+  bus_thread_.stop();
+  {
+    std::lock_guard<std::mutex> lock(reconnect_mutex_);
+    reconnect_stop_ = true;
+  }
+  reconnect_condition_.notify_all();
+  if (reconnect_thread_.joinable()) {
+    reconnect_thread_.join();
+  }
+}
 
 return_type DynamixelHardware::configure(const hardware_interface::HardwareInfo & info)
 {
@@ -61,6 +199,8 @@ return_type DynamixelHardware::configure(const hardware_interface::HardwareInfo
   joints_.resize(num_joints, Joint());
   virtual_joints_.resize(num_virtual_joints, Joint());
   joint_ids_.resize(num_joints, 0);
+  joint_index_by_id_.fill(-1);
+  extended_position_.assign(num_joints, false);
 
   int joint_index = 0;
   int virtual_joint_index = 0;
@@ -90,6 +230,7 @@ return_type DynamixelHardware::configure(const hardware_interface::HardwareInfo
     } else {
       // real joint
       joint_ids_[joint_index] = std::stoi(info_.joints[i].parameters.at("id"));
+      joint_index_by_id_[joint_ids_[joint_index]] = joint_index;
       joints_[joint_index].name = info_.joints[i].name;
       joints_[joint_index].state.position = std::numeric_limits<double>::quiet_NaN();
       joints_[joint_index].state.velocity = std::numeric_limits<double>::quiet_NaN();
@@ -98,29 +239,69 @@ return_type DynamixelHardware::configure(const hardware_interface::HardwareInfo
       joints_[joint_index].command.velocity = std::numeric_limits<double>::quiet_NaN();
       joints_[joint_index].command.effort = std::numeric_limits<double>::quiet_NaN();
 
-      if (info_.joints[i].name == "gripper") {
-        gripper_id_ = joint_ids_[joint_index];
+      if (
+        info_.joints[i].name == "gripper" ||
+        (info_.joints[i].parameters.find("end_effector") != info_.joints[i].parameters.end() &&
+         info_.joints[i].parameters.at("end_effector") == "true")) {
+        gripper_indices_.push_back(joint_index);
+        gripper_ids_.push_back(joint_ids_[joint_index]);
+        float current_limit = kDefaultGripperCurrentLimit;
         if (info_.joints[i].parameters.find("current_limit") != info_.joints[i].parameters.end()) {
-          gripper_current_limit_ = std::stof(info_.joints[i].parameters.at("current_limit"));
+          current_limit = std::stof(info_.joints[i].parameters.at("current_limit"));
           RCLCPP_INFO(
-            rclcpp::get_logger(kDynamixelHardware), "gripper_current_limit: %.3f",
-            gripper_current_limit_);
+            rclcpp::get_logger(kDynamixelHardware), "gripper_current_limit: %.3f", current_limit);
         } else {
           RCLCPP_WARN(
             rclcpp::get_logger(kDynamixelHardware),
-            "current_limit is not set for gripper. Use default: %.3f", gripper_current_limit_);
+            "current_limit is not set for gripper. Use default: %.3f", current_limit);
         }
+        joints_[joint_index].profile.current = current_limit;
         RCLCPP_INFO(
           rclcpp::get_logger(kDynamixelHardware), "joint_id %d: %d is_gripper", i,
           joint_ids_[joint_index]);
       } else {
+        arm_indices_.push_back(joint_index);
+        arm_ids_.push_back(joint_ids_[joint_index]);
+        // continuous joints are position controlled over any number of turns
+        extended_position_[joint_index] =
+          info_.joints[i].parameters.find("extended_position") !=
+            info_.joints[i].parameters.end() &&
+          info_.joints[i].parameters.at("extended_position") == "true";
         RCLCPP_INFO(
-          rclcpp::get_logger(kDynamixelHardware), "joint_id %d: %d", i, joint_ids_[joint_index]);
+          rclcpp::get_logger(kDynamixelHardware), "joint_id %d: %d%s", i, joint_ids_[joint_index],
+          extended_position_[joint_index] ? " extended_position" : "");
       }
       ++joint_index;
     }
   }
 
+  // Present_Position, Present_Velocity and Present_Current are always read, followed by the
+  // optional state_items, which are exported as state interfaces of the same name.
+  if (info_.hardware_parameters.find("state_items") != info_.hardware_parameters.end()) {
+    std::stringstream state_items(info_.hardware_parameters.at("state_items"));
+    std::string name;
+    while (std::getline(state_items, name, ',')) {
+      name.erase(0, name.find_first_not_of(' '));
+      name.erase(name.find_last_not_of(' ') + 1);
+      if (!name.empty()) {
+        layout_.state_items.push_back(RegisterItem{name, 0, 0, 0});
+        RCLCPP_INFO(rclcpp::get_logger(kDynamixelHardware), "state_item: %s", name.c_str());
+      }
+    }
+  }
+  item_states_.assign(
+    joints_.size() * layout_.state_items.size(), std::numeric_limits<double>::quiet_NaN());
+  diagnostics_.assign(joints_.size(), JointDiagnostics());
+
+  // a recording stands in for the bus, with or without use_dummy
+  if (info_.hardware_parameters.find("replay_file") != info_.hardware_parameters.end()) {
+    if (configure_replay(info_.hardware_parameters.at("replay_file")) != return_type::OK) {
+      return return_type::ERROR;
+    }
+    status_ = hardware_interface::status::CONFIGURED;
+    return return_type::OK;
+  }
+
   if (
     info_.hardware_parameters.find("use_dummy") != info_.hardware_parameters.end() &&
     info_.hardware_parameters.at("use_dummy") == "true") {
@@ -133,10 +314,57 @@ return_type DynamixelHardware::configure(const hardware_interface::HardwareInfo
   auto usb_port = info_.hardware_parameters.at("usb_port");
   auto baud_rate = std::stoi(info_.hardware_parameters.at("baud_rate"));
   const char * log = nullptr;
+  usb_port_ = usb_port;
 
   RCLCPP_INFO(rclcpp::get_logger(kDynamixelHardware), "usb_port: %s", usb_port.c_str());
   RCLCPP_INFO(rclcpp::get_logger(kDynamixelHardware), "baud_rate: %d", baud_rate);
 
+  // a servo that keeps failing is left out until it answers a probe again
+  evict_after_ = 10;
+  if (info_.hardware_parameters.find("evict_after") != info_.hardware_parameters.end()) {
+    evict_after_ = std::stoi(info_.hardware_parameters.at("evict_after"));
+  }
+  if (info_.hardware_parameters.find("probe_period_ms") != info_.hardware_parameters.end()) {
+    probe_period_ =
+      std::chrono::milliseconds(std::stoi(info_.hardware_parameters.at("probe_period_ms")));
+  }
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "evict_after: %u, probe_period_ms: %ld", evict_after_,
+    static_cast<long>(probe_period_.count()));
+
+  if (info_.hardware_parameters.find("reconnect_period_ms") != info_.hardware_parameters.end()) {
+    reconnect_period_ = std::chrono::milliseconds(
+      std::stoi(info_.hardware_parameters.at("reconnect_period_ms")));
+  }
+
+  if (info_.hardware_parameters.find("read_budget_us") != info_.hardware_parameters.end()) {
+    read_budget_ =
+      std::chrono::microseconds(std::stoi(info_.hardware_parameters.at("read_budget_us")));
+  }
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "read_budget_us: %ld",
+    static_cast<long>(read_budget_.count()));
+
+  // per-servo timeouts learned from the response times, within these limits
+  const auto response_parameter = [this](const char * name, const int64_t default_us) {
+    const auto it = info_.hardware_parameters.find(name);
+    return std::chrono::microseconds(it == info_.hardware_parameters.end()
+                                       ? default_us
+                                       : std::stoll(it->second));
+  };
+  const auto response_timeout_min = response_parameter("response_timeout_min_us", 100);
+  const auto response_timeout_max = response_parameter(
+    "response_timeout_max_us", std::chrono::duration_cast<std::chrono::microseconds>(
+                                 ResponseTimeouts::Duration::max()).count());
+  const auto response_timeout_margin = response_parameter("response_timeout_margin_us", 200);
+  response_timeouts_.configure(
+    joints_.size(), response_timeout_min, response_timeout_max, response_timeout_margin);
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware),
+    "response_timeout_min_us: %ld, response_timeout_margin_us: %ld",
+    static_cast<long>(response_timeout_min.count()),
+    static_cast<long>(response_timeout_margin.count()));
+
   if (!dynamixel_workbench_.init(usb_port.c_str(), baud_rate, &log)) {
     RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
     return return_type::ERROR;
@@ -150,80 +378,238 @@ return_type DynamixelHardware::configure(const hardware_interface::HardwareInfo
     }
   }
 
-  enable_torque(false);
-  set_control_mode(ControlMode::Position, true);
-  if (
-    info_.hardware_parameters.find("torque_off") == info_.hardware_parameters.end() ||
-    info_.hardware_parameters.at("torque_off") != "true") {
-    enable_torque(true);
+  // The workbench's sync read rejects the whole group when a single status packet is missing,
+  // so the hot path builds and parses its packets itself on its own handle of the same port.
+  // Protocol 1.0 has no Sync Read, those servos are read by legacy_read().
+  use_protocol1_ = dynamixel_workbench_.getProtocolVersion() == 1.0f;
+  if (use_protocol1_) {
+    RCLCPP_INFO(rclcpp::get_logger(kDynamixelHardware), "Protocol 1.0");
   }
-
-  const ControlItem * goal_position =
-    dynamixel_workbench_.getItemInfo(joint_ids_[0], kGoalPositionItem);
-  if (goal_position == nullptr) {
+  std::string error;
+  if (!serial_port_.open(usb_port, baud_rate, error)) {
+    RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", error.c_str());
     return return_type::ERROR;
   }
 
-  const ControlItem * goal_velocity =
-    dynamixel_workbench_.getItemInfo(joint_ids_[0], kGoalVelocityItem);
-  if (goal_velocity == nullptr) {
-    goal_velocity = dynamixel_workbench_.getItemInfo(joint_ids_[0], kMovingSpeedItem);
+  // Servos at Status_Return_Level 1, possibly from a previous run, do not acknowledge the
+  // workbench's writes. They are switched to full status returns around them. On Protocol 1.0
+  // the level is in the EEPROM, which is not rewritten on every mode switch, so it is only set
+  // to 2 once.
+  if (info_.hardware_parameters.find("status_return_level") != info_.hardware_parameters.end()) {
+    const int level = std::stoi(info_.hardware_parameters.at("status_return_level"));
+    if (
+      level < 1 || level > kStatusReturnAll ||
+      !find_item(status_return_item_, {kStatusReturnLevelItem})) {
+      RCLCPP_FATAL(
+        rclcpp::get_logger(kDynamixelHardware),
+        "status_return_level must be 1 or 2 on servos with %s", kStatusReturnLevelItem);
+      return return_type::ERROR;
+    }
+    if (use_protocol1_ && level != kStatusReturnAll) {
+      RCLCPP_FATAL(
+        rclcpp::get_logger(kDynamixelHardware),
+        "status_return_level must be 2 on Protocol 1.0 servos, whose %s is in the EEPROM",
+        kStatusReturnLevelItem);
+      return return_type::ERROR;
+    }
+    status_return_level_ = level;
+    status_return_params_.assign(2 * joints_.size(), 0);
+    acknowledge_writes(true);
   }
-  if (goal_velocity == nullptr) {
+
+  combined_write_ =
+    info_.hardware_parameters.find("combined_write") != info_.hardware_parameters.end() &&
+    info_.hardware_parameters.at("combined_write") == "true";
+  profile_interpolation_ =
+    info_.hardware_parameters.find("profile_interpolation") !=
+      info_.hardware_parameters.end() &&
+    info_.hardware_parameters.at("profile_interpolation") == "true";
+  if (profile_interpolation_ && !combined_write_) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "profile_interpolation requires combined_write");
     return return_type::ERROR;
   }
+  if (
+    info_.hardware_parameters.find("profile_acceleration_ratio") !=
+    info_.hardware_parameters.end()) {
+    profile_acceleration_ratio_ =
+      std::stod(info_.hardware_parameters.at("profile_acceleration_ratio"));
+    if (profile_acceleration_ratio_ <= 0.0 || profile_acceleration_ratio_ > 0.5) {
+      RCLCPP_FATAL(
+        rclcpp::get_logger(kDynamixelHardware), "profile_acceleration_ratio must be in (0, 0.5]");
+      return return_type::ERROR;
+    }
+  }
+  if (profile_interpolation_) {
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware), "profile_interpolation: acceleration ratio %.2f",
+      profile_acceleration_ratio_);
+  }
+  if (info_.hardware_parameters.find("bus_stats_period_ms") != info_.hardware_parameters.end()) {
+    stats_period_ =
+      std::chrono::milliseconds(std::stoi(info_.hardware_parameters.at("bus_stats_period_ms")));
+  }
 
-  const ControlItem * present_position =
-    dynamixel_workbench_.getItemInfo(joint_ids_[0], kPresentPositionItem);
-  if (present_position == nullptr) {
+  if (
+    !find_item(layout_.goal_position, {kGoalPositionItem}) ||
+    !find_item(layout_.goal_velocity, {kGoalVelocityItem, kMovingSpeedItem}) ||
+    !find_item(layout_.present_position, {kPresentPositionItem}) ||
+    !find_item(layout_.present_velocity, {kPresentVelocityItem, kPresentSpeedItem}) ||
+    !find_item(layout_.present_current, {kPresentCurrentItem, kPresentLoadItem})) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Goal or present items not found",
+      joint_ids_[0]);
     return return_type::ERROR;
   }
+  for (auto & item : layout_.state_items) {
+    if (!find_item(item, {item.name.c_str()})) {
+      RCLCPP_FATAL(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Unknown control item %s", joint_ids_[0],
+        item.name.c_str());
+      return return_type::ERROR;
+    }
+  }
+
+  // Goal_Current is optional, servos without it are limited to position and velocity control
+  scales_.assign(joints_.size(), ValueScale());
+  current_limits_.assign(joints_.size(), 0);
+  const bool has_goal_current = find_item(layout_.goal_current, {kGoalCurrentItem});
+  for (uint i = 0; i < joints_.size(); i++) {
+    const ModelInfo * model = dynamixel_workbench_.getModelInfo(joint_ids_[i]);
+    if (model == nullptr) {
+      RCLCPP_FATAL(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Model info not found", joint_ids_[i]);
+      return return_type::ERROR;
+    }
+    // mA per raw unit, from a large value so that the rounding to int16 does not show
+    const double current_unit =
+      has_goal_current
+        ? dynamixel_workbench_.convertValue2Current(joint_ids_[i], static_cast<int16_t>(10000)) /
+            10000.0
+        : dynamixel_workbench_.convertValue2Current(static_cast<int16_t>(1));
+    scales_[i] = make_value_scale(*model, current_unit, use_protocol1_);
+  }
+  if (has_goal_current) {
+    for (uint i = 0; i < joints_.size(); i++) {
+      int32_t limit = std::numeric_limits<int16_t>::max();
+      if (!dynamixel_workbench_.itemRead(joint_ids_[i], kCurrentLimitItem, &limit, &log)) {
+        RCLCPP_WARN(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] %s, Goal_Current is not clamped",
+          joint_ids_[i], kCurrentLimitItem);
+      }
+      current_limits_[i] = limit;
+      RCLCPP_INFO(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Current limit: %.1f mA", joint_ids_[i],
+        limit * scales_[i].current_unit);
+    }
+  }
+
+  // Goal_PWM is optional too, for PWM control
+  pwm_limits_.assign(joints_.size(), 0);
+  if (find_item(layout_.goal_pwm, {kGoalPwmItem})) {
+    for (uint i = 0; i < joints_.size(); i++) {
+      int32_t limit = kPwmValuePerPercent * 100;
+      if (!dynamixel_workbench_.itemRead(joint_ids_[i], kPwmLimitItem, &limit, &log)) {
+        RCLCPP_WARN(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] %s, Goal_PWM is clamped to 100%%",
+          joint_ids_[i], kPwmLimitItem);
+      }
+      pwm_limits_[i] = limit;
+      RCLCPP_INFO(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] PWM limit: %.1f%%", joint_ids_[i],
+        limit / kPwmValuePerPercent);
+    }
+  }
 
-  const ControlItem * present_velocity =
-    dynamixel_workbench_.getItemInfo(joint_ids_[0], kPresentVelocityItem);
-  if (present_velocity == nullptr) {
-    present_velocity = dynamixel_workbench_.getItemInfo(joint_ids_[0], kPresentSpeedItem);
+  // the mode and torque switches write these registers themselves
+  const bool has_mode_items =
+    use_protocol1_ ? find_item(cw_angle_limit_item_, {kCwAngleLimitItem}) &&
+                       find_item(ccw_angle_limit_item_, {kCcwAngleLimitItem})
+                   : find_item(operating_mode_item_, {kOperatingModeItem});
+  if (!has_mode_items || !find_item(torque_enable_item_, {kTorqueEnableItem})) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Mode or torque items not found",
+      joint_ids_[0]);
+    return return_type::ERROR;
   }
-  if (present_velocity == nullptr) {
+  enable_torque(false);
+  if (set_control_mode(ControlMode::Position, true) != return_type::OK) {
     return return_type::ERROR;
   }
 
-  const ControlItem * present_current =
-    dynamixel_workbench_.getItemInfo(joint_ids_[0], kPresentCurrentItem);
-  if (present_current == nullptr) {
-    present_current = dynamixel_workbench_.getItemInfo(joint_ids_[0], kPresentLoadItem);
+  const bool use_indirect =
+    info_.hardware_parameters.find("use_indirect") == info_.hardware_parameters.end() ||
+    info_.hardware_parameters.at("use_indirect") != "false";
+  if (configure_read_block(use_indirect) != return_type::OK) {
+    return return_type::ERROR;
+  }
+  if (combined_write_ && configure_write_block() != return_type::OK) {
+    return return_type::ERROR;
+  }
+  configure_gripper_block();
+  if (configure_multi_turn() != return_type::OK) {
+    return return_type::ERROR;
+  }
+  configure_groups();
+
+  read_data_.assign(joints_.size() * layout_.read_length, 0);
+  read_params_.reserve(joints_.size());
+  read_received_.assign(joints_.size(), false);
+  read_failures_.assign(joints_.size(), 0);
+  evicted_.assign(joints_.size(), false);
+  profile_goals_.assign(joints_.size(), std::numeric_limits<double>::quiet_NaN());
+  profile_currents_.assign(joints_.size(), std::numeric_limits<double>::quiet_NaN());
+  // the goal block, or the largest of the single goal items
+  const uint16_t param_length = std::max<uint16_t>(
+    {layout_.write_length, layout_.goal_position.length, layout_.goal_velocity.length,
+     layout_.goal_current.length, layout_.goal_pwm.length});
+  write_params_.assign(joints_.size() * (1 + param_length), 0);
+  // a Fast Sync Read answers with one status packet for all servos
+  fast_sync_read_ =
+    info_.hardware_parameters.find("fast_sync_read") != info_.hardware_parameters.end() &&
+    info_.hardware_parameters.at("fast_sync_read") == "true";
+  if (fast_sync_read_ && use_protocol1_) {
+    RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "fast_sync_read requires Protocol 2.0");
+    return return_type::ERROR;
+  }
+  protocol_.reserve(
+    4 + std::max(write_params_.size(), gripper_params_.size()),
+    fast_sync_read_ ? joints_.size() * (4 + layout_.read_length) : 1 + layout_.read_length);
+  protocol1_.reserve(
+    std::max({2 + write_params_.size(), 2 + gripper_params_.size(), 1 + 3 * joints_.size()}),
+    layout_.read_length);
+  bulk_entries_.reserve(joints_.size());
+
+  if (tune_servos() != return_type::OK) {
+    return return_type::ERROR;
   }
-  if (present_current == nullptr) {
+  if (use_protocol1_ && configure_legacy_read() != return_type::OK) {
     return return_type::ERROR;
   }
 
-  control_items_[kGoalPositionItem] = goal_position;
-  control_items_[kGoalVelocityItem] = goal_velocity;
-  control_items_[kPresentPositionItem] = present_position;
-  control_items_[kPresentVelocityItem] = present_velocity;
-  control_items_[kPresentCurrentItem] = present_current;
+  if (
+    info_.hardware_parameters.find("state_snapshot") != info_.hardware_parameters.end() &&
+    configure_snapshot(info_.hardware_parameters.at("state_snapshot")) != return_type::OK) {
+    return return_type::ERROR;
+  }
 
-  if (!dynamixel_workbench_.addSyncWriteHandler(
-        control_items_[kGoalPositionItem]->address, control_items_[kGoalPositionItem]->data_length,
-        &log)) {
-    RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+  if (
+    info_.hardware_parameters.find("record_file") != info_.hardware_parameters.end() &&
+    configure_recorder(info_.hardware_parameters.at("record_file")) != return_type::OK) {
     return return_type::ERROR;
   }
 
-  if (!dynamixel_workbench_.addSyncWriteHandler(
-        control_items_[kGoalVelocityItem]->address, control_items_[kGoalVelocityItem]->data_length,
-        &log)) {
-    RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+  if (plan_bus_budget(usb_port) != return_type::OK) {
     return return_type::ERROR;
   }
 
-  uint16_t start_address = std::min(
-    control_items_[kPresentPositionItem]->address, control_items_[kPresentCurrentItem]->address);
-  uint16_t read_length = control_items_[kPresentPositionItem]->data_length +
-                         control_items_[kPresentVelocityItem]->data_length +
-                         control_items_[kPresentCurrentItem]->data_length + 2;
-  if (!dynamixel_workbench_.addSyncReadHandler(start_address, read_length, &log)) {
-    RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+  if (
+    info_.hardware_parameters.find("torque_off") == info_.hardware_parameters.end() ||
+    info_.hardware_parameters.at("torque_off") != "true") {
+    enable_torque(true);
+  }
+
+  if (configure_bus_thread() != return_type::OK) {
     return return_type::ERROR;
   }
 
@@ -243,7 +629,11 @@ std::vector<hardware_interface::StateInterface> DynamixelHardware::export_state_
   //   state_interfaces.emplace_back(hardware_interface::StateInterface(
   //     info_.joints[i].name, hardware_interface::HW_IF_EFFORT, &joints_[i].state.effort));
   // }
-  for (auto & joint : joints_) {
+  // with streaming the controllers see a copy that the bus thread publishes into
+  std::vector<Joint> & joints = streaming_ ? stream_joints_ : joints_;
+  std::vector<double> & item_states = streaming_ ? stream_item_states_ : item_states_;
+  std::vector<JointDiagnostics> & diagnostics = streaming_ ? stream_diagnostics_ : diagnostics_;
+  for (auto & joint : joints) {
     state_interfaces.emplace_back(hardware_interface::StateInterface(
       joint.name, hardware_interface::HW_IF_POSITION, &joint.state.position));
     state_interfaces.emplace_back(hardware_interface::StateInterface(
@@ -252,6 +642,31 @@ std::vector<hardware_interface::StateInterface> DynamixelHardware::export_state_
       joint.name, hardware_interface::HW_IF_EFFORT, &joint.state.effort));
   }
 
+  const std::size_t num_items = layout_.state_items.size();
+  for (uint i = 0; i < joints.size(); i++) {
+    for (uint j = 0; j < num_items; j++) {
+      state_interfaces.emplace_back(hardware_interface::StateInterface(
+        joints[i].name, layout_.state_items[j].name, &item_states[i * num_items + j]));
+    }
+    state_interfaces.emplace_back(hardware_interface::StateInterface(
+      joints[i].name, kHwIfResponseTimeout, &diagnostics[i].response_timeout));
+    state_interfaces.emplace_back(hardware_interface::StateInterface(
+      joints[i].name, kHwIfRetryTimeout, &diagnostics[i].retry_timeout));
+    state_interfaces.emplace_back(
+      hardware_interface::StateInterface(joints[i].name, kHwIfStale, &diagnostics[i].stale));
+    state_interfaces.emplace_back(
+      hardware_interface::StateInterface(joints[i].name, kHwIfEvicted, &diagnostics[i].evicted));
+  }
+
+  if (streaming_) {
+    state_interfaces.emplace_back(
+      hardware_interface::StateInterface(info_.name, kHwIfSetpointQueueDepth, &queue_depth_));
+    state_interfaces.emplace_back(
+      hardware_interface::StateInterface(info_.name, kHwIfSetpointUnderruns, &queue_underruns_));
+    state_interfaces.emplace_back(
+      hardware_interface::StateInterface(info_.name, kHwIfBusOverruns, &bus_overruns_));
+  }
+
   for (auto & joint : virtual_joints_) {
     state_interfaces.emplace_back(hardware_interface::StateInterface(
       joint.name, hardware_interface::HW_IF_POSITION, &joint.state.position));
@@ -274,11 +689,37 @@ std::vector<hardware_interface::CommandInterface> DynamixelHardware::export_comm
   //   command_interfaces.emplace_back(hardware_interface::CommandInterface(
   //     info_.joints[i].name, hardware_interface::HW_IF_VELOCITY, &joints_[i].command.velocity));
   // }
-  for (auto & joint : joints_) {
+  std::vector<Joint> & joints = streaming_ ? stream_joints_ : joints_;
+  for (auto & joint : joints) {
     command_interfaces.emplace_back(hardware_interface::CommandInterface(
       joint.name, hardware_interface::HW_IF_POSITION, &joint.command.position));
     command_interfaces.emplace_back(hardware_interface::CommandInterface(
       joint.name, hardware_interface::HW_IF_VELOCITY, &joint.command.velocity));
+    command_interfaces.emplace_back(hardware_interface::CommandInterface(
+      joint.name, hardware_interface::HW_IF_EFFORT, &joint.command.effort));
+    // with profile_interpolation the profiles are computed from the position commands
+    if (combined_write_ && !profile_interpolation_) {
+      command_interfaces.emplace_back(hardware_interface::CommandInterface(
+        joint.name, kHwIfProfileVelocity, &joint.profile.velocity));
+      command_interfaces.emplace_back(hardware_interface::CommandInterface(
+        joint.name, kHwIfProfileAcceleration, &joint.profile.acceleration));
+    }
+  }
+  // the arm joints of servos with Goal_PWM can be driven by duty cycle
+  if (layout_.goal_pwm.length > 0) {
+    for (auto i : arm_indices_) {
+      command_interfaces.emplace_back(
+        hardware_interface::CommandInterface(joints[i].name, kHwIfPwm, &joints[i].pwm));
+    }
+  }
+  // the end-effectors send Goal_Current with every position goal
+  for (uint i = 0; i < joints.size(); i++) {
+    if (
+      combined_write_ ||
+      std::find(gripper_indices_.cbegin(), gripper_indices_.cend(), i) != gripper_indices_.cend()) {
+      command_interfaces.emplace_back(hardware_interface::CommandInterface(
+        joints[i].name, kHwIfGoalCurrent, &joints[i].profile.current));
+    }
   }
 
   for (auto & joint : virtual_joints_) {
@@ -286,6 +727,8 @@ std::vector<hardware_interface::CommandInterface> DynamixelHardware::export_comm
       joint.name, hardware_interface::HW_IF_POSITION, &joint.command.position));
     command_interfaces.emplace_back(hardware_interface::CommandInterface(
       joint.name, hardware_interface::HW_IF_VELOCITY, &joint.command.velocity));
+    command_interfaces.emplace_back(hardware_interface::CommandInterface(
+      joint.name, hardware_interface::HW_IF_EFFORT, &joint.command.effort));
   }
 
   return command_interfaces;
@@ -323,6 +766,8 @@ return_type DynamixelHardware::start()
 
   read();
   reset_command();
+  // setpoints from before a stop would be interpolated from
+  setpoint_queue_.clear();
   write();
 
   status_ = hardware_interface::status::STARTED;
@@ -341,219 +786,2300 @@ return_type DynamixelHardware::read()
   if (use_dummy_) {
     return return_type::OK;
   }
+  if (replay_.is_open()) {
+    return read_replay();
+  }
 
-  std::vector<uint8_t> ids(joints_.size(), 0);
-  std::vector<int32_t> positions(joints_.size(), 0);
-  std::vector<int32_t> velocities(joints_.size(), 0);
-  std::vector<int32_t> currents(joints_.size(), 0);
+  if (streaming_) {
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    for (uint i = 0; i < stream_joints_.size(); i++) {
+      stream_joints_[i].state = stream_states_[i];
+    }
+    std::copy(
+      stream_published_items_.cbegin(), stream_published_items_.cend(),
+      stream_item_states_.begin());
+    std::copy(
+      stream_published_diagnostics_.cbegin(), stream_published_diagnostics_.cend(),
+      stream_diagnostics_.begin());
+    queue_depth_ = setpoint_queue_.depth();
+    queue_underruns_ = setpoint_queue_.underruns();
+    bus_overruns_ = bus_thread_.overruns();
+    if (stream_reset_.exchange(false)) {
+      reset_command();
+    }
+    return return_type::OK;
+  }
 
-  std::copy(joint_ids_.begin(), joint_ids_.end(), ids.begin());
-  const char * log = nullptr;
+  if (bus_thread_.running()) {
+    return_type result = return_type::OK;
+    auto job = [this, &result]() { result = read_bus(); };
+    bus_thread_.run(job);
+    return result;
+  }
+  return read_bus();
+}
 
-  if (!dynamixel_workbench_.syncRead(
-        kPresentPositionVelocityCurrentIndex, ids.data(), ids.size(), &log)) {
-    RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+return_type DynamixelHardware::read_bus()
+{
+  if (reconnecting_) {
+    // the last states are held until the port is back
+    for (auto & diagnostics : diagnostics_) {
+      diagnostics.stale = 1.0;
+    }
+    return return_type::OK;
   }
 
-  if (!dynamixel_workbench_.getSyncReadData(
-        kPresentPositionVelocityCurrentIndex, ids.data(), ids.size(),
-        control_items_[kPresentCurrentItem]->address,
-        control_items_[kPresentCurrentItem]->data_length, currents.data(), &log)) {
-    RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+  const auto start = std::chrono::steady_clock::now();
+  const auto deadline = start + read_budget_;
+  std::fill(read_received_.begin(), read_received_.end(), false);
+
+  // one evicted servo at a time is read along every probe_period_ms
+  probe_index_ = -1;
+  if (evicted_count_ > 0 && start - probe_time_ >= probe_period_) {
+    probe_time_ = start;
+    for (std::size_t k = 1; k <= joints_.size(); k++) {
+      const std::size_t i = (probe_cursor_ + k) % joints_.size();
+      if (evicted_[i]) {
+        probe_index_ = i;
+        probe_cursor_ = i;
+        break;
+      }
+    }
   }
 
-  if (!dynamixel_workbench_.getSyncReadData(
-        kPresentPositionVelocityCurrentIndex, ids.data(), ids.size(),
-        control_items_[kPresentVelocityItem]->address,
-        control_items_[kPresentVelocityItem]->data_length, velocities.data(), &log)) {
-    RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+  // Retry only the ids that did not answer, as long as the cycle budget allows.
+  std::size_t pending = joints_.size() - evicted_count_ + (probe_index_ >= 0 ? 1 : 0);
+  pending -= sync_read(false, deadline);
+  while (pending > 0 && std::chrono::steady_clock::now() < deadline && !serial_port_.lost()) {
+    pending -= sync_read(true, deadline);
+  }
+  if (serial_port_.lost()) {
+    // the reconnect thread owns the port and the read buffers from here on
+    start_reconnect();
+    for (auto & diagnostics : diagnostics_) {
+      diagnostics.stale = 1.0;
+    }
+    return return_type::OK;
   }
 
-  if (!dynamixel_workbench_.getSyncReadData(
-        kPresentPositionVelocityCurrentIndex, ids.data(), ids.size(),
-        control_items_[kPresentPositionItem]->address,
-        control_items_[kPresentPositionItem]->data_length, positions.data(), &log)) {
-    RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+  const RegisterLayout & layout = layout_;
+  if (recorder_.is_open()) {
+    BusRecord & record =
+      recorder_.begin(RecordKind::SyncRead, layout.read_address, layout.read_length);
+    const std::size_t capacity = BusRecorder::capacity_for(layout.read_length);
+    for (uint i = 0; i < joints_.size() && record.count < capacity; i++) {
+      if (read_received_[i]) {
+        uint8_t * entry = &record.payload[record.count++ * (1 + layout.read_length)];
+        entry[0] = joint_ids_[i];
+        std::copy_n(&read_data_[i * layout.read_length], layout.read_length, entry + 1);
+      }
+    }
+    recorder_.commit(record);
   }
 
-  for (uint i = 0; i < ids.size(); i++) {
-    joints_[i].state.position = dynamixel_workbench_.convertValue2Radian(ids[i], positions[i]);
-    joints_[i].state.velocity = dynamixel_workbench_.convertValue2Velocity(ids[i], velocities[i]);
-    joints_[i].state.effort = dynamixel_workbench_.convertValue2Current(currents[i]);
+  decode_read();
+  // the transactions sync_read() and legacy_read() wait on
+  const Transaction first = use_protocol1_ ? (bulk_read_ ? Transaction::BulkRead
+                                                          : Transaction::Read)
+                            : fast_sync_read_ ? Transaction::FastSyncRead
+                                              : Transaction::SyncRead;
+  const Transaction retry = use_protocol1_ ? Transaction::Read : Transaction::SyncReadRetry;
+  const auto seconds = [](const ResponseTimeouts::Duration timeout) {
+    return timeout.count() > 0 ? std::chrono::duration<double>(timeout).count()
+                               : std::numeric_limits<double>::quiet_NaN();
+  };
+  for (uint i = 0; i < joints_.size(); i++) {
+    diagnostics_[i].response_timeout = seconds(response_timeouts_.timeout(first, i));
+    diagnostics_[i].retry_timeout = seconds(response_timeouts_.timeout(retry, i));
+  }
+  if (stats_period_.count() > 0) {
+    update_bus_stats();
+  }
+  if (state_snapshot_.is_open()) {
+    publish_snapshot(start);
   }
 
   return return_type::OK;
 }
 
-return_type DynamixelHardware::write()
+void DynamixelHardware::start_reconnect()
 {
-  // for virtual joints, just copy command to state
-  for (auto & joint : virtual_joints_) {
-    joint.state.position = joint.command.position;
-    joint.state.velocity = joint.command.velocity;
-    joint.state.effort = joint.command.effort;
+  bool reconnecting = false;
+  if (!reconnecting_.compare_exchange_strong(reconnecting, true)) {
+    return;
   }
+  RCLCPP_ERROR(
+    rclcpp::get_logger(kDynamixelHardware), "Lost %s, reconnecting every %ld ms",
+    usb_port_.c_str(), static_cast<long>(reconnect_period_.count()));
+  // a previous reconnect thread is done once reconnecting_ was cleared
+  if (reconnect_thread_.joinable()) {
+    reconnect_thread_.join();
+  }
+  // torque_enabled_ and control_mode_ stay with the bus side
+  reconnect_torque_enabled_ = torque_enabled_;
+  reconnect_control_mode_ = control_mode_;
+  reconnect_thread_ = std::thread([this]() { reconnect_loop(); });
+}
 
-  if (use_dummy_) {
-    for (auto & joint : joints_) {
-      joint.state.position = joint.command.position;
-    }
+bool DynamixelHardware::defer_switch(const bool torque_enabled, const ControlMode mode)
+{
+  std::lock_guard<std::mutex> lock(reconnect_switch_mutex_);
+  if (!reconnecting_) {
+    return false;
+  }
+  reconnect_torque_enabled_ = torque_enabled;
+  reconnect_control_mode_ = mode;
+  return true;
+}
 
-    return return_type::OK;
+void DynamixelHardware::reconnect_loop()
+{
+  const auto start = std::chrono::steady_clock::now();
+  serial_port_.close();
+  std::unique_lock<std::mutex> lock(reconnect_mutex_);
+  while (!reconnect_condition_.wait_for(
+    lock, reconnect_period_, [this]() { return reconnect_stop_; })) {
+    // the port belongs to the bus side again once it succeeded
+    if (reconnect()) {
+      RCLCPP_INFO(
+        rclcpp::get_logger(kDynamixelHardware), "Reconnected to %s after %.1f s",
+        usb_port_.c_str(),
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+      return;
+    }
   }
+  reconnecting_ = false;
+}
 
-  std::vector<uint8_t> ids(joints_.size(), 0);
-  std::vector<int32_t> commands(joints_.size(), 0);
+bool DynamixelHardware::reconnect()
+{
+  std::string error;
+  if (!serial_port_.open(usb_port_, serial_port_.baud_rate(), error)) {
+    RCLCPP_DEBUG(rclcpp::get_logger(kDynamixelHardware), "%s", error.c_str());
+    return false;
+  }
 
-  std::copy(joint_ids_.begin(), joint_ids_.end(), ids.begin());
-  const char * log = nullptr;
+  // Servos that lost power come back with the torque off and full status returns, those that
+  // did not at status_return_level. The operating mode is in their EEPROM.
+  const bool toggle_level =
+    !status_return_params_.empty() && status_return_level_ != kStatusReturnAll;
+  if (toggle_level) {
+    write_status_return_level(kStatusReturnAll);
+  }
 
-  if (std::any_of(
-        joints_.cbegin(), joints_.cend(), [](auto j) { return j.command.velocity != 0.0; })) {
-    // Velocity control
-    set_control_mode(ControlMode::Velocity);
-    for (uint i = 0; i < ids.size(); i++) {
-      commands[i] = dynamixel_workbench_.convertVelocity2Value(
-        ids[i], static_cast<float>(joints_[i].command.velocity));
-    }
-    if (!dynamixel_workbench_.syncWrite(
-          kGoalVelocityIndex, ids.data(), ids.size(), commands.data(), 1, &log)) {
-      RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+  // the ids are verified by every servo not evicted answering a read of its torque
+  std::vector<int32_t> torque(joints_.size(), 0);
+  std::size_t active = 0;
+  std::size_t answered = 0;
+  for (uint i = 0; i < joints_.size(); i++) {
+    if (!evicted_[i]) {
+      active++;
+      answered += read_register(joint_ids_[i], torque_enable_item_, torque[i]) ? 1 : 0;
     }
-    return return_type::OK;
-  } else if (std::any_of(
-               joints_.cbegin(), joints_.cend(), [](auto j) { return j.command.effort != 0.0; })) {
-    // Effort control
-    RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "Effort control is not implemented");
-    return return_type::ERROR;
+  }
+  if (answered < active) {
+    RCLCPP_WARN(
+      rclcpp::get_logger(kDynamixelHardware), "%zu of %zu servos answer on %s", answered, active,
+      usb_port_.c_str());
+    serial_port_.close();
+    return false;
   }
 
-  // Position control
-  set_control_mode(ControlMode::Position);
-  for (uint i = 0; i < ids.size(); i++) {
-    commands[i] = dynamixel_workbench_.convertRadian2Value(
-      ids[i], static_cast<float>(joints_[i].command.position));
+  // the switches deferred while a pass ran are applied by another one
+  std::unique_lock<std::mutex> lock(reconnect_switch_mutex_);
+  bool torque_enabled = false;
+  ControlMode mode = ControlMode::Position;
+  do {
+    torque_enabled = reconnect_torque_enabled_;
+    mode = reconnect_control_mode_;
+    lock.unlock();
+    for (uint i = 0; i < joints_.size(); i++) {
+      if (evicted_[i]) {
+        continue;
+      }
+      const uint8_t id = joint_ids_[i];
+      bool written = false;
+      if (!write_mode(i, joint_mode(i, mode), written)) {
+        RCLCPP_WARN(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Failed to restore the operating mode",
+          id);
+        serial_port_.close();
+        return false;
+      }
+      if (written) {
+        RCLCPP_WARN(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Operating mode restored", id);
+        // writing the mode turned the torque off
+        torque[i] = 0;
+      }
+      const int32_t enable = torque_enabled ? 1 : 0;
+      if (torque[i] != enable && !write_register(id, torque_enable_item_, enable)) {
+        RCLCPP_WARN(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Failed to write %s", id,
+          kTorqueEnableItem);
+        serial_port_.close();
+        return false;
+      }
+      torque[i] = enable;
+    }
+    lock.lock();
+  } while (torque_enabled != reconnect_torque_enabled_ || mode != reconnect_control_mode_);
+  if (toggle_level) {
+    write_status_return_level(status_return_level_);
   }
-  if (!dynamixel_workbench_.syncWrite(
-        kGoalPositionIndex, ids.data(), ids.size(), commands.data(), 1, &log)) {
-    RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+  // a servo that lost power counts its position within one turn again
+  for (auto & position : multi_turn_) {
+    position.rebase = true;
   }
-
-  return return_type::OK;
+  reconnecting_ = false;
+  return true;
 }
 
-return_type DynamixelHardware::enable_torque(const bool enabled)
+void DynamixelHardware::decode_read()
 {
-  const char * log = nullptr;
-
-  if (enabled && !torque_enabled_) {
-    for (uint i = 0; i < joints_.size(); ++i) {
-      if (!dynamixel_workbench_.torqueOn(joint_ids_[i], &log)) {
-        RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
-        return return_type::ERROR;
+  const RegisterLayout & layout = layout_;
+  const std::size_t num_items = layout.state_items.size();
+  for (uint i = 0; i < joints_.size(); i++) {
+    diagnostics_[i].stale = read_received_[i] ? 0.0 : 1.0;
+    if (!read_received_[i]) {
+      if (evicted_[i]) {
+        continue;
       }
-    }
-    reset_command();
-    RCLCPP_INFO(rclcpp::get_logger(kDynamixelHardware), "Torque enabled");
-  } else if (!enabled && torque_enabled_) {
-    for (uint i = 0; i < joints_.size(); ++i) {
-      if (!dynamixel_workbench_.torqueOff(joint_ids_[i], &log)) {
-        RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
-        return return_type::ERROR;
+      // keep the last good state of a servo that timed out
+      if (read_failures_[i]++ == 0) {
+        RCLCPP_WARN(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] No status packet, keeping last state",
+          joint_ids_[i]);
+      }
+      if (evict_after_ > 0 && read_failures_[i] >= evict_after_) {
+        // the others no longer wait for it
+        evicted_[i] = true;
+        evicted_count_++;
+        diagnostics_[i].evicted = 1.0;
+        RCLCPP_WARN(
+          rclcpp::get_logger(kDynamixelHardware),
+          "[ID:%d] Evicted from the sync groups after %u failed reads", joint_ids_[i],
+          read_failures_[i]);
       }
+      continue;
+    }
+    if (evicted_[i]) {
+      evicted_[i] = false;
+      evicted_count_--;
+      diagnostics_[i].evicted = 0.0;
+      RCLCPP_INFO(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Readmitted to the sync groups",
+        joint_ids_[i]);
+    }
+    if (read_failures_[i] > 0) {
+      RCLCPP_INFO(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Recovered after %u failed reads",
+        joint_ids_[i], read_failures_[i]);
+      read_failures_[i] = 0;
     }
-    RCLCPP_INFO(rclcpp::get_logger(kDynamixelHardware), "Torque disabled");
-  }
 
-  torque_enabled_ = enabled;
-  return return_type::OK;
+    const uint8_t * data = &read_data_[i * layout.read_length];
+    for (uint j = 0; j < num_items; j++) {
+      const RegisterItem & item = layout.state_items[j];
+      item_states_[i * num_items + j] = get_value(data + item.offset, item.length);
+    }
+  }
+  for (const auto & group : read_groups_) {
+    (this->*group.decode)(group);
+  }
 }
 
-return_type DynamixelHardware::set_control_mode(const ControlMode & mode, const bool force_set)
+return_type DynamixelHardware::configure_snapshot(const std::string & name)
 {
-  const char * log = nullptr;
+  std::string error;
+  if (!state_snapshot_.create(name, joints_.size(), error)) {
+    RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", error.c_str());
+    return return_type::ERROR;
+  }
 
-  if (mode == ControlMode::Velocity && (force_set || control_mode_ != ControlMode::Velocity)) {
-    bool torque_enabled = torque_enabled_;
-    if (torque_enabled) {
-      enable_torque(false);
-    }
+  SnapshotHeader * header = state_snapshot_.header();
+  header->raw_length = std::min<std::size_t>(layout_.read_length, kSnapshotRawCapacity);
+  header->position_offset = layout_.present_position.offset;
+  header->position_length = layout_.present_position.length;
+  header->velocity_offset = layout_.present_velocity.offset;
+  header->velocity_length = layout_.present_velocity.length;
+  header->current_offset = layout_.present_current.offset;
+  header->current_length = layout_.present_current.length;
+  for (uint i = 0; i < joints_.size(); i++) {
+    SnapshotJoint & joint = state_snapshot_.joints()[i];
+    joints_[i].name.copy(joint.name, kSnapshotNameCapacity - 1);
+    joint.id = joint_ids_[i];
+  }
+  // readers attach once the ids and the layout are in
+  state_snapshot_.publish();
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "State snapshot in shared memory %s", name.c_str());
+  return return_type::OK;
+}
 
-    for (uint i = 0; i < joint_ids_.size(); ++i) {
-      if (!dynamixel_workbench_.setVelocityControlMode(joint_ids_[i], &log)) {
-        RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
-        return return_type::ERROR;
-      }
-    }
-    RCLCPP_INFO(rclcpp::get_logger(kDynamixelHardware), "Velocity control");
-    control_mode_ = ControlMode::Velocity;
+void DynamixelHardware::publish_snapshot(const std::chrono::steady_clock::time_point start)
+{
+  const auto now = std::chrono::steady_clock::now();
+  SnapshotHeader * header = state_snapshot_.header();
+  SnapshotJoint * joints = state_snapshot_.joints();
 
-    if (torque_enabled) {
-      enable_torque(true);
-    }
-  } else if (
-    mode == ControlMode::Position && (force_set || control_mode_ != ControlMode::Position)) {
-    bool torque_enabled = torque_enabled_;
-    if (torque_enabled) {
-      enable_torque(false);
+  state_snapshot_.begin_write();
+  bool failed = false;
+  for (uint i = 0; i < joints_.size(); i++) {
+    joints[i].failures = read_failures_[i];
+    if (!read_received_[i]) {
+      joints[i].total_failures++;
+      failed = true;
+      continue;
     }
+    joints[i].position = joints_[i].state.position;
+    joints[i].velocity = joints_[i].state.velocity;
+    joints[i].effort = joints_[i].state.effort;
+    std::copy_n(&read_data_[i * layout_.read_length], header->raw_length, joints[i].raw);
+  }
+  header->cycle++;
+  header->failed_cycles += failed ? 1 : 0;
+  header->monotonic_ns =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+  header->realtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+  header->read_duration_ns =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+  state_snapshot_.end_write();
+}
 
-    for (uint i = 0; i < joint_ids_.size(); ++i) {
-      if (!dynamixel_workbench_.setPositionControlMode(joint_ids_[i], &log)) {
-        RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
-        return return_type::ERROR;
+void DynamixelHardware::update_bus_stats()
+{
+  if (control_mode_ == ControlMode::Position) {
+    for (uint i = 0; i < joints_.size(); i++) {
+      if (read_received_[i]) {
+        const double error = std::abs(joints_[i].command.position - joints_[i].state.position);
+        stats_error_sq_ += error * error;
+        stats_error_max_ = std::max(stats_error_max_, error);
+        stats_samples_++;
       }
     }
-    RCLCPP_INFO(rclcpp::get_logger(kDynamixelHardware), "Position control");
-    control_mode_ = ControlMode::Position;
+  }
 
-    if (torque_enabled) {
-      enable_torque(true);
-    }
-  } else if (control_mode_ != ControlMode::Velocity && control_mode_ != ControlMode::Position) {
-    RCLCPP_FATAL(
-      rclcpp::get_logger(kDynamixelHardware), "Only position/velocity control are implemented");
-    return return_type::ERROR;
+  const auto now = std::chrono::steady_clock::now();
+  if (now - stats_start_ < stats_period_) {
+    return;
+  }
+  if (stats_start_.time_since_epoch().count() > 0) {
+    const double seconds = std::chrono::duration<double>(now - stats_start_).count();
+    const double bytes_per_second = stats_bytes_ / seconds;
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware),
+      "Bus load: %.0f B/s (%.1f%% of the baud rate), %.1f writes/s, "
+      "tracking error rms %.4f rad max %.4f rad",
+      bytes_per_second, bytes_per_second * 1000.0 / serial_port_.baud_rate(),
+      stats_writes_ / seconds,
+      stats_samples_ > 0 ? std::sqrt(stats_error_sq_ / stats_samples_) : 0.0, stats_error_max_);
   }
+  stats_start_ = now;
+  stats_bytes_ = 0;
+  stats_writes_ = 0;
+  stats_error_sq_ = 0.0;
+  stats_error_max_ = 0.0;
+  stats_samples_ = 0;
+}
 
-  // set current-based position control mode for gripper
-  if (
-    gripper_id_ != 255 &&
-    (force_set || gripper_control_mode_ != ControlMode::CurrentBasedPosition)) {
-    bool torque_enabled = torque_enabled_;
-    if (torque_enabled) {
-      enable_torque(false);
-    }
+return_type DynamixelHardware::write()
+{
+  // for virtual joints, just copy command to state
+  for (auto & joint : virtual_joints_) {
+    joint.state.position = joint.command.position;
+    joint.state.velocity = joint.command.velocity;
+    joint.state.effort = joint.command.effort;
+  }
 
-    if (!dynamixel_workbench_.setCurrentBasedPositionControlMode(gripper_id_, &log)) {
-      RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
-      return return_type::ERROR;
-    }
-    int32_t current =
-      dynamixel_workbench_.convertCurrent2Value(gripper_id_, gripper_current_limit_);
-    if (!dynamixel_workbench_.itemWrite(gripper_id_, kGoalCurrentItem, current, &log)) {
-      RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
-      return return_type::ERROR;
+  if (use_dummy_) {
+    for (auto & joint : joints_) {
+      joint.state.position = joint.command.position;
     }
 
-    RCLCPP_INFO(
-      rclcpp::get_logger(kDynamixelHardware), "Current-based position control for gripper");
-    gripper_control_mode_ = ControlMode::CurrentBasedPosition;
+    return return_type::OK;
+  }
 
-    if (torque_enabled) {
-      enable_torque(true);
+  if (streaming_) {
+    for (uint i = 0; i < stream_joints_.size(); i++) {
+      double * setpoint = &stream_setpoint_[i * kSetpointWidth];
+      setpoint[0] = stream_joints_[i].command.position;
+      setpoint[1] = stream_joints_[i].command.velocity;
+      setpoint[2] = stream_joints_[i].command.effort;
+      setpoint[3] = stream_joints_[i].profile.velocity;
+      setpoint[4] = stream_joints_[i].profile.acceleration;
+      setpoint[5] = stream_joints_[i].profile.current;
+      setpoint[6] = stream_joints_[i].pwm;
     }
+    setpoint_queue_.push(SetpointQueue::Clock::now(), stream_setpoint_.data());
+    return return_type::OK;
   }
 
-  return return_type::OK;
+  if (bus_thread_.running()) {
+    return_type result = return_type::OK;
+    auto job = [this, &result]() { result = write_bus(); };
+    bus_thread_.run(job);
+    return result;
+  }
+  return write_bus();
 }
 
-return_type DynamixelHardware::reset_command()
+return_type DynamixelHardware::write_bus()
+{
+  if (reconnecting_) {
+    return return_type::OK;
+  }
+
+  // the end-effectors stay in current-based position control at their own rate
+  const auto now = std::chrono::steady_clock::now();
+  if (!gripper_ids_.empty() && now - gripper_write_time_ >= gripper_period_) {
+    gripper_write_time_ = now;
+    write_gripper_goals();
+  }
+  // the port may have gone with the write to the end-effectors
+  if (arm_ids_.empty() || reconnecting_) {
+    return return_type::OK;
+  }
+
+  const auto arm_command = [this](double JointValue::*value) {
+    return std::any_of(arm_indices_.cbegin(), arm_indices_.cend(), [this, value](std::size_t i) {
+      return joints_[i].command.*value != 0.0;
+    });
+  };
+  if (arm_command(&JointValue::velocity)) {
+    // Velocity control
+    if (set_control_mode(ControlMode::Velocity) != return_type::OK) {
+      return return_type::ERROR;
+    }
+    const RegisterItem & item = layout_.goal_velocity;
+    std::size_t count = 0;
+    for (const auto & group : arm_groups_) {
+      count = (this->*group.encode_velocity)(group, count);
+    }
+    send_sync_write(item.address, item.length, write_params_.data(), count);
+    return return_type::OK;
+  } else if (arm_command(&JointValue::effort)) {
+    // Effort control
+    if (layout_.goal_current.length == 0) {
+      RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "Effort control is not supported");
+      return return_type::ERROR;
+    }
+    if (set_control_mode(ControlMode::Currrent) != return_type::OK) {
+      return return_type::ERROR;
+    }
+    return write_goal_current();
+  } else if (std::any_of(arm_indices_.cbegin(), arm_indices_.cend(), [this](std::size_t i) {
+               return !std::isnan(joints_[i].pwm);
+             })) {
+    // PWM control
+    if (layout_.goal_pwm.length == 0) {
+      RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "PWM control is not supported");
+      return return_type::ERROR;
+    }
+    if (set_control_mode(ControlMode::PWM) != return_type::OK) {
+      return return_type::ERROR;
+    }
+    return write_goal_pwm();
+  }
+
+  // Position control
+  if (control_mode_ != ControlMode::Position) {
+    // the goals have to go out again after a mode switch
+    std::fill(
+      profile_goals_.begin(), profile_goals_.end(), std::numeric_limits<double>::quiet_NaN());
+  }
+  if (set_control_mode(ControlMode::Position) != return_type::OK) {
+    return return_type::ERROR;
+  }
+  if (combined_write_) {
+    return write_goal_block(layout_, arm_indices_, write_params_, profile_interpolation_);
+  }
+  const RegisterItem & item = layout_.goal_position;
+  std::size_t count = 0;
+  for (const auto & group : arm_groups_) {
+    count = (this->*group.encode_position)(group, count);
+  }
+  send_sync_write(item.address, item.length, write_params_.data(), count);
+
+  return return_type::OK;
+}
+
+return_type DynamixelHardware::configure_bus_thread()
+{
+  const auto & parameters = info_.hardware_parameters;
+  std::string error;
+
+  if (
+    parameters.find("lock_memory") != parameters.end() && parameters.at("lock_memory") == "true") {
+    if (!BusThread::lock_memory(error)) {
+      RCLCPP_WARN(rclcpp::get_logger(kDynamixelHardware), "%s", error.c_str());
+    } else {
+      RCLCPP_INFO(rclcpp::get_logger(kDynamixelHardware), "Memory locked");
+    }
+  }
+
+  BusThreadConfig config;
+  if (parameters.find("bus_thread_priority") != parameters.end()) {
+    config.priority = std::stoi(parameters.at("bus_thread_priority"));
+  }
+  if (parameters.find("bus_thread_cpu") != parameters.end()) {
+    config.cpu = std::stoi(parameters.at("bus_thread_cpu"));
+  }
+  double bus_rate = 0.0;
+  if (parameters.find("bus_rate") != parameters.end()) {
+    bus_rate = std::stod(parameters.at("bus_rate"));
+  }
+  if (config.priority <= 0 && config.cpu < 0 && bus_rate <= 0.0) {
+    // bus I/O stays on the controller_manager thread
+    return return_type::OK;
+  }
+
+  error.clear();
+  if (!bus_thread_.start(config, error)) {
+    RCLCPP_WARN(
+      rclcpp::get_logger(kDynamixelHardware), "Bus thread settings not applied: %s",
+      error.c_str());
+  }
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "Bus thread: %s", bus_thread_.describe().c_str());
+
+  if (
+    parameters.find("bus_thread_benchmark") != parameters.end() &&
+    parameters.at("bus_thread_benchmark") == "true") {
+    // wake-up jitter of a 1 kHz loop with the default and with the bus thread settings
+    const auto period = std::chrono::microseconds(1000);
+    const int iterations = 1000;
+    const JitterStats default_stats = BusThread::measure_jitter(period, iterations);
+    JitterStats bus_stats;
+    auto job = [&bus_stats, period]() {
+      bus_stats = BusThread::measure_jitter(period, iterations);
+    };
+    bus_thread_.run(job);
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware),
+      "Wake-up latency at 1 kHz: default mean %.1f us max %.1f us, bus thread mean %.1f us max "
+      "%.1f us",
+      default_stats.mean_us, default_stats.max_us, bus_stats.mean_us, bus_stats.max_us);
+  }
+
+  if (bus_rate > 0.0) {
+    return configure_stream(bus_rate);
+  }
+  return return_type::OK;
+}
+
+return_type DynamixelHardware::plan_bus_budget(const std::string & usb_port)
+{
+  const auto & parameters = info_.hardware_parameters;
+  const char * log = nullptr;
+  const double byte_us = kBitsPerByte * 1e6 / serial_port_.baud_rate();
+  const std::size_t num_joints = joints_.size();
+
+  // The servos answer a sync read one after the other, each after its return delay.
+  double return_delay_us = 0.0;
+  double max_return_delay_us = 0.0;
+  for (auto id : joint_ids_) {
+    int32_t return_delay = 0;
+    if (dynamixel_workbench_.itemRead(id, kReturnDelayTimeItem, &return_delay, &log)) {
+      return_delay_us += return_delay * kReturnDelayUnitUs;
+      max_return_delay_us = std::max(max_return_delay_us, return_delay * kReturnDelayUnitUs);
+    }
+  }
+
+  // A USB serial adapter holds received bytes for up to its latency timer before passing
+  // them on, once per read transaction.
+  double latency_us = 0.0;
+  bool latency_known = true;
+  if (parameters.find("usb_latency_us") != parameters.end()) {
+    latency_us = std::stod(parameters.at("usb_latency_us"));
+  } else {
+    const std::string device = usb_port.substr(usb_port.find_last_of('/') + 1);
+    std::ifstream latency_timer("/sys/bus/usb-serial/devices/" + device + "/latency_timer");
+    int latency_ms = 0;
+    latency_known = static_cast<bool>(latency_timer >> latency_ms);
+    latency_us = latency_ms * 1000.0;
+  }
+  // the status packets are waited for this long after they are due on the line
+  response_margin_ = std::chrono::microseconds(static_cast<int64_t>(
+    return_delay_us + (latency_known ? latency_us : kUnknownUsbLatencyUs) + kResponseSlackUs));
+  read_margin_ = std::chrono::microseconds(static_cast<int64_t>(
+    max_return_delay_us + (latency_known ? latency_us : kUnknownUsbLatencyUs) +
+    kResponseSlackUs));
+
+  double read_bytes = kSyncPacketOverhead + num_joints +
+                      num_joints * (kStatusPacketOverhead + layout_.read_length);
+  double read_latency_us = latency_us;
+  double sync_overhead = kSyncPacketOverhead;
+  if (use_protocol1_) {
+    const double status_bytes = num_joints * (kProtocol1PacketOverhead + layout_.read_length);
+    if (bulk_read_) {
+      read_bytes = kProtocol1PacketOverhead + 1 + 3 * num_joints + status_bytes;
+    } else {
+      // an address and a length to every servo, and a USB round trip each
+      read_bytes = num_joints * (kProtocol1PacketOverhead + 2) + status_bytes;
+      read_latency_us = num_joints * latency_us;
+    }
+    sync_overhead = kProtocol1PacketOverhead + 2;
+  }
+  const uint16_t write_length =
+    combined_write_ ? layout_.write_length : layout_.goal_position.length;
+  double write_bytes = 0.0;
+  if (!arm_ids_.empty()) {
+    write_bytes += sync_overhead + arm_ids_.size() * (1 + write_length);
+  }
+  if (!gripper_ids_.empty()) {
+    // at the full rate, as the worst case
+    if (gripper_layout_.write_length > 0) {
+      write_bytes += sync_overhead + gripper_ids_.size() * (1 + gripper_layout_.write_length);
+    } else {
+      for (const auto & item : {gripper_layout_.goal_current, gripper_layout_.goal_position}) {
+        if (item.length > 0) {
+          write_bytes += sync_overhead + gripper_ids_.size() * (1 + item.length);
+        }
+      }
+    }
+  }
+  const double read_us = read_bytes * byte_us + return_delay_us + read_latency_us;
+  const double write_us = write_bytes * byte_us;
+  const double cycle_us = read_us + write_us;
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware),
+    "Bus cycle: read %.0f bytes %.0f us (return delay %.0f us, USB latency %.0f us), "
+    "write %.0f bytes %.0f us, total %.0f us, at most %.0f Hz",
+    read_bytes, read_us, return_delay_us, read_latency_us, write_bytes, write_us, cycle_us,
+    1e6 / cycle_us);
+
+  // the bus runs at bus_rate when streaming and at the controller rate otherwise
+  double rate = 0.0;
+  if (parameters.find("bus_rate") != parameters.end()) {
+    rate = std::stod(parameters.at("bus_rate"));
+  } else if (parameters.find("update_rate") != parameters.end()) {
+    rate = std::stod(parameters.at("update_rate"));
+  }
+  if (rate <= 0.0) {
+    return return_type::OK;
+  }
+
+  const double headroom = 1.0 - cycle_us * rate / 1e6;
+  if (headroom >= 0.0) {
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware), "Bus headroom at %.0f Hz: %.0f%%", rate,
+      headroom * 100.0);
+    return return_type::OK;
+  }
+  if (
+    parameters.find("enforce_rate") != parameters.end() &&
+    parameters.at("enforce_rate") == "true") {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "Bus cycle of %.0f us cannot run at %.0f Hz",
+      cycle_us, rate);
+    return return_type::ERROR;
+  }
+  RCLCPP_WARN(
+    rclcpp::get_logger(kDynamixelHardware), "Bus cycle of %.0f us cannot run at %.0f Hz",
+    cycle_us, rate);
+  return return_type::OK;
+}
+
+return_type DynamixelHardware::configure_stream(const double bus_rate)
+{
+  const auto & parameters = info_.hardware_parameters;
+  std::size_t queue_size = 64;
+  if (parameters.find("stream_queue_size") != parameters.end()) {
+    queue_size = std::stoul(parameters.at("stream_queue_size"));
+  }
+  if (parameters.find("stream_delay_ms") != parameters.end()) {
+    stream_delay_ = std::chrono::microseconds(
+      static_cast<int64_t>(std::stod(parameters.at("stream_delay_ms")) * 1000.0));
+  }
+  if (queue_size < 2) {
+    RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "stream_queue_size must be at least 2");
+    return return_type::ERROR;
+  }
+
+  setpoint_queue_.configure(joints_.size() * kSetpointWidth, queue_size);
+  stream_setpoint_.assign(joints_.size() * kSetpointWidth, 0.0);
+  stream_sample_.assign(joints_.size() * kSetpointWidth, 0.0);
+  stream_joints_ = joints_;
+  stream_item_states_ = item_states_;
+  stream_states_.assign(joints_.size(), JointValue());
+  stream_published_items_ = item_states_;
+  stream_diagnostics_ = diagnostics_;
+  stream_published_diagnostics_ = diagnostics_;
+
+  // publish a first state before start() resets the commands to it
+  read_bus();
+  publish_stream_state();
+
+  streaming_ = true;
+  stream_job_ = [this]() { stream_tick(); };
+  const auto period =
+    std::chrono::microseconds(static_cast<int64_t>(std::round(1e6 / bus_rate)));
+  bus_thread_.run_periodic(period, stream_job_);
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware),
+    "Streaming at %.1f Hz, %.1f ms behind the controller, %zu setpoints queued at most", bus_rate,
+    stream_delay_.count() / 1000.0, queue_size);
+  return return_type::OK;
+}
+
+void DynamixelHardware::stream_tick()
+{
+  const auto time = SetpointQueue::Clock::now() - stream_delay_;
+  if (setpoint_queue_.sample(time, stream_sample_.data())) {
+    for (uint i = 0; i < joints_.size(); i++) {
+      const double * setpoint = &stream_sample_[i * kSetpointWidth];
+      joints_[i].command.position = setpoint[0];
+      joints_[i].command.velocity = setpoint[1];
+      joints_[i].command.effort = setpoint[2];
+      joints_[i].profile.velocity = setpoint[3];
+      joints_[i].profile.acceleration = setpoint[4];
+      joints_[i].profile.current = setpoint[5];
+      joints_[i].pwm = setpoint[6];
+    }
+    write_bus();
+  }
+  read_bus();
+  publish_stream_state();
+}
+
+void DynamixelHardware::publish_stream_state()
+{
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  for (uint i = 0; i < joints_.size(); i++) {
+    stream_states_[i] = joints_[i].state;
+  }
+  std::copy(item_states_.cbegin(), item_states_.cend(), stream_published_items_.begin());
+  std::copy(
+    diagnostics_.cbegin(), diagnostics_.cend(), stream_published_diagnostics_.begin());
+}
+
+return_type DynamixelHardware::configure_read_block(const bool use_indirect)
+{
+  std::vector<RegisterItem *> items = {
+    &layout_.present_position, &layout_.present_velocity, &layout_.present_current};
+  for (auto & item : layout_.state_items) {
+    items.push_back(&item);
+  }
+
+  RegisterItem indirect_data;
+  RegisterItem indirect_address;
+  if (
+    !use_indirect || !find_item(indirect_data, {kIndirectData1Item}) ||
+    !find_item(indirect_address, {kIndirectAddress1Item})) {
+    // read the contiguous span covering every item
+    uint16_t end_address = 0;
+    layout_.read_address = std::numeric_limits<uint16_t>::max();
+    for (const auto item : items) {
+      layout_.read_address = std::min(layout_.read_address, item->address);
+      end_address = std::max<uint16_t>(end_address, item->address + item->length);
+    }
+    for (auto item : items) {
+      item->offset = item->address - layout_.read_address;
+    }
+    layout_.read_length = end_address - layout_.read_address;
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware), "Read block: %d bytes from address %d",
+      layout_.read_length, layout_.read_address);
+    return return_type::OK;
+  }
+
+  layout_.read_address = indirect_data.address;
+  layout_.read_length = 0;
+  for (auto item : items) {
+    item->offset = layout_.read_length;
+    layout_.read_length += item->length;
+  }
+  if (layout_.read_length > kIndirectDataCount) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "Read block of %d bytes exceeds %d indirect bytes",
+      layout_.read_length, kIndirectDataCount);
+    return return_type::ERROR;
+  }
+
+  if (map_indirect(items, 0) != return_type::OK) {
+    return return_type::ERROR;
+  }
+
+  for (const auto item : items) {
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware), "Indirect read block: %s at +%d (%d bytes)",
+      item->name.c_str(), item->offset, item->length);
+  }
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "Read block: %d bytes from address %d",
+    layout_.read_length, layout_.read_address);
+  return return_type::OK;
+}
+
+return_type DynamixelHardware::configure_write_block()
+{
+  RegisterItem indirect_data;
+  if (
+    !find_item(indirect_data, {kIndirectData1Item}) ||
+    layout_.read_address != indirect_data.address) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "combined_write requires the indirect read block");
+    return return_type::ERROR;
+  }
+
+  layout_.profile_velocity.name = kProfileVelocityItem;
+  layout_.profile_acceleration.name = kProfileAccelerationItem;
+  layout_.goal_current.name = kGoalCurrentItem;
+  const std::vector<RegisterItem *> items = {
+    &layout_.goal_position, &layout_.profile_velocity, &layout_.profile_acceleration,
+    &layout_.goal_current};
+  layout_.write_length = 0;
+  for (auto item : items) {
+    if (item->length == 0 && !find_item(*item, {item->name.c_str()})) {
+      RCLCPP_WARN(
+        rclcpp::get_logger(kDynamixelHardware), "%s is left out of the goal block",
+        item->name.c_str());
+    }
+    item->offset = layout_.write_length;
+    layout_.write_length += item->length;
+  }
+  if (layout_.read_length + layout_.write_length > kIndirectDataCount) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware),
+      "Read and goal blocks of %d bytes exceed %d indirect bytes",
+      layout_.read_length + layout_.write_length, kIndirectDataCount);
+    return return_type::ERROR;
+  }
+
+  if (map_indirect(items, layout_.read_length) != return_type::OK) {
+    return return_type::ERROR;
+  }
+
+  layout_.write_address = layout_.read_address + layout_.read_length;
+  for (const auto item : items) {
+    if (item->length > 0) {
+      RCLCPP_INFO(
+        rclcpp::get_logger(kDynamixelHardware), "Indirect goal block: %s at +%d (%d bytes)",
+        item->name.c_str(), item->offset, item->length);
+    }
+  }
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "Goal block: %d bytes from address %d",
+    layout_.write_length, layout_.write_address);
+  return return_type::OK;
+}
+
+bool DynamixelHardware::find_item(RegisterItem & item, std::initializer_list<const char *> names)
+{
+  for (const char * name : names) {
+    const ControlItem * control_item = dynamixel_workbench_.getItemInfo(joint_ids_[0], name);
+    if (control_item != nullptr) {
+      item = RegisterItem{name, control_item->address, control_item->data_length, 0};
+      return true;
+    }
+  }
+  return false;
+}
+
+return_type DynamixelHardware::map_indirect(
+  const std::vector<RegisterItem *> & items, const uint16_t first_entry)
+{
+  const char * log = nullptr;
+  uint16_t length = 0;
+  for (const auto item : items) {
+    length += item->length;
+  }
+
+  // Every servo maps its own addresses of the items, so mixed models share one block.
+  std::vector<uint8_t> indirect_addresses(length * 2, 0);
+  std::vector<uint32_t> mapped(indirect_addresses.size(), 0);
+  for (auto id : joint_ids_) {
+    const ControlItem * indirect_address =
+      dynamixel_workbench_.getItemInfo(id, kIndirectAddress1Item);
+    const ControlItem * indirect_data = dynamixel_workbench_.getItemInfo(id, kIndirectData1Item);
+    if (
+      indirect_address == nullptr || indirect_data == nullptr ||
+      indirect_data->address != layout_.read_address) {
+      RCLCPP_FATAL(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Indirect address is not available", id);
+      return return_type::ERROR;
+    }
+
+    std::size_t entry = 0;
+    for (const auto item : items) {
+      if (item->length == 0) {
+        continue;
+      }
+      const ControlItem * control_item = dynamixel_workbench_.getItemInfo(id, item->name.c_str());
+      if (control_item == nullptr || control_item->data_length != item->length) {
+        RCLCPP_FATAL(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Control item %s does not match", id,
+          item->name.c_str());
+        return return_type::ERROR;
+      }
+      for (uint16_t address = control_item->address;
+           address < control_item->address + item->length; address++) {
+        indirect_addresses[entry++] = address & 0xff;
+        indirect_addresses[entry++] = address >> 8;
+      }
+    }
+
+    const uint16_t table_address = indirect_address->address + first_entry * 2;
+    if (
+      !dynamixel_workbench_.writeRegister(
+        id, table_address, indirect_addresses.size(), indirect_addresses.data(), &log) ||
+      !dynamixel_workbench_.readRegister(id, table_address, mapped.size(), mapped.data(), &log)) {
+      RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+      return return_type::ERROR;
+    }
+    if (!std::equal(indirect_addresses.begin(), indirect_addresses.end(), mapped.begin())) {
+      RCLCPP_FATAL(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Indirect address verification failed",
+        id);
+      return return_type::ERROR;
+    }
+  }
+
+  return return_type::OK;
+}
+
+bool DynamixelHardware::update_profiles(const std::vector<std::size_t> & indices)
+{
+  bool changed = false;
+  for (auto i : indices) {
+    changed = changed || joints_[i].command.position != profile_goals_[i] ||
+              joints_[i].profile.current != profile_currents_[i];
+  }
+  if (!changed) {
+    return false;
+  }
+
+  // The time since the previous goal is the segment the servo has to cover the move in,
+  // accelerating and decelerating over profile_acceleration_ratio of it each.
+  const auto now = std::chrono::steady_clock::now();
+  const double period = std::max(
+    0.001, std::min(0.5, std::chrono::duration<double>(now - profile_goal_time_).count()));
+  profile_goal_time_ = now;
+  for (auto i : indices) {
+    const double from =
+      std::isnan(profile_goals_[i]) ? joints_[i].state.position : profile_goals_[i];
+    const double distance = std::abs(joints_[i].command.position - from);
+    joints_[i].profile.velocity = distance / (period * (1.0 - profile_acceleration_ratio_));
+    joints_[i].profile.acceleration =
+      joints_[i].profile.velocity / (period * profile_acceleration_ratio_);
+    profile_goals_[i] = joints_[i].command.position;
+    profile_currents_[i] = joints_[i].profile.current;
+  }
+  return true;
+}
+
+return_type DynamixelHardware::configure_replay(const std::string & path)
+{
+  const auto & parameters = info_.hardware_parameters;
+  std::string error;
+  if (!replay_.open(path, error)) {
+    RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", error.c_str());
+    return return_type::ERROR;
+  }
+  replay_realtime_ =
+    parameters.find("replay_speed") == parameters.end() || parameters.at("replay_speed") != "max";
+
+  // the recording has the present items and the plain goal writes only
+  if (!layout_.state_items.empty()) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "state_items cannot be replayed from %s",
+      path.c_str());
+    return return_type::ERROR;
+  }
+  if (
+    parameters.find("combined_write") != parameters.end() &&
+    parameters.at("combined_write") == "true") {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "combined_write cannot be replayed from %s",
+      path.c_str());
+    return return_type::ERROR;
+  }
+  const RecordFileHeader & header = *replay_.header();
+
+  layout_.read_address = header.read_address;
+  layout_.read_length = header.read_length;
+  layout_.present_position =
+    RegisterItem{kPresentPositionItem, 0, header.position_length, header.position_offset};
+  layout_.present_velocity =
+    RegisterItem{kPresentVelocityItem, 0, header.velocity_length, header.velocity_offset};
+  layout_.present_current =
+    RegisterItem{kPresentCurrentItem, 0, header.current_length, header.current_offset};
+  layout_.goal_position =
+    RegisterItem{kGoalPositionItem, header.goal_address[0], header.goal_position_length, 0};
+  layout_.goal_velocity =
+    RegisterItem{kGoalVelocityItem, header.goal_velocity_address, header.goal_velocity_length, 0};
+  layout_.goal_current =
+    RegisterItem{kGoalCurrentItem, header.goal_current_address, header.goal_current_length, 0};
+
+  scales_.assign(joints_.size(), ValueScale());
+  current_limits_.assign(joints_.size(), 0);
+  for (uint i = 0; i < joints_.size(); i++) {
+    const RecordJoint * joint = nullptr;
+    for (uint32_t j = 0; j < header.joint_count; j++) {
+      if (header.joints[j].id == joint_ids_[i]) {
+        joint = &header.joints[j];
+      }
+    }
+    if (joint == nullptr) {
+      RCLCPP_FATAL(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Not in the recording %s", joint_ids_[i],
+        path.c_str());
+      return return_type::ERROR;
+    }
+    scales_[i] = joint->scale;
+    current_limits_[i] = joint->current_limit;
+  }
+  configure_gripper_block();
+  if (configure_multi_turn() != return_type::OK) {
+    return return_type::ERROR;
+  }
+  configure_groups();
+
+  read_data_.assign(joints_.size() * layout_.read_length, 0);
+  read_received_.assign(joints_.size(), false);
+  read_failures_.assign(joints_.size(), 0);
+  evicted_.assign(joints_.size(), false);
+  profile_goals_.assign(joints_.size(), std::numeric_limits<double>::quiet_NaN());
+  profile_currents_.assign(joints_.size(), std::numeric_limits<double>::quiet_NaN());
+  const uint16_t param_length = std::max<uint16_t>(
+    {layout_.goal_position.length, layout_.goal_velocity.length, layout_.goal_current.length});
+  write_params_.assign(joints_.size() * (1 + param_length), 0);
+
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "Replaying %s %s", path.c_str(),
+    replay_realtime_ ? "in real time" : "as fast as it is read");
+  return return_type::OK;
+}
+
+return_type DynamixelHardware::read_replay()
+{
+  const bool finished = replay_.finished();
+  const BusRecord * record = replay_.next_read(replay_realtime_);
+  if (record == nullptr) {
+    if (!finished && replay_.finished()) {
+      RCLCPP_INFO(
+        rclcpp::get_logger(kDynamixelHardware),
+        "Replay finished: %lu reads, %lu skipped, %lu writes compared, %lu differed, %lu not "
+        "recorded",
+        static_cast<unsigned long>(replay_.reads()),
+        static_cast<unsigned long>(replay_.skipped_reads()),
+        static_cast<unsigned long>(replay_.compared_writes()),
+        static_cast<unsigned long>(replay_.mismatched_writes()),
+        static_cast<unsigned long>(replay_.unrecorded_writes()));
+    }
+    // the joints hold the last recorded state
+    return return_type::OK;
+  }
+
+  std::fill(read_received_.begin(), read_received_.end(), false);
+  const uint8_t * entry = record->payload;
+  for (uint8_t k = 0; k < record->count; k++, entry += 1 + record->length) {
+    const int i = joint_index_by_id_[entry[0]];
+    if (i >= 0 && record->length == layout_.read_length) {
+      std::copy_n(entry + 1, layout_.read_length, &read_data_[i * layout_.read_length]);
+      read_received_[i] = true;
+    }
+  }
+  decode_read();
+  return return_type::OK;
+}
+
+return_type DynamixelHardware::configure_recorder(const std::string & path)
+{
+  uint64_t capacity = 65536;
+  if (info_.hardware_parameters.find("record_capacity") != info_.hardware_parameters.end()) {
+    capacity = std::stoull(info_.hardware_parameters.at("record_capacity"));
+  }
+  // A record has room for a fixed number of entries, and the header for kRecordMaxJoints. A
+  // recording that drops some of them would not replay.
+  if (joints_.size() > kRecordMaxJoints) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "record_file holds %zu joints at most, not %zu",
+      kRecordMaxJoints, joints_.size());
+    return return_type::ERROR;
+  }
+  const uint16_t entry_length = std::max<uint16_t>(
+    {layout_.read_length, layout_.write_length, layout_.goal_position.length,
+     layout_.goal_velocity.length, layout_.goal_current.length, layout_.goal_pwm.length,
+     gripper_layout_.write_length, status_return_item_.length});
+  if (joints_.size() > BusRecorder::capacity_for(entry_length)) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware),
+      "record_file holds %zu servos of %d bytes per record, not %zu",
+      BusRecorder::capacity_for(entry_length), entry_length, joints_.size());
+    return return_type::ERROR;
+  }
+  std::string error;
+  if (!recorder_.open(path, capacity, error)) {
+    RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", error.c_str());
+    return return_type::ERROR;
+  }
+
+  RecordFileHeader * header = recorder_.header();
+  header->read_address = layout_.read_address;
+  header->read_length = layout_.read_length;
+  header->position_offset = layout_.present_position.offset;
+  header->position_length = layout_.present_position.length;
+  header->velocity_offset = layout_.present_velocity.offset;
+  header->velocity_length = layout_.present_velocity.length;
+  header->current_offset = layout_.present_current.offset;
+  header->current_length = layout_.present_current.length;
+  header->goal_velocity_address = layout_.goal_velocity.address;
+  header->goal_velocity_length = layout_.goal_velocity.length;
+  header->goal_current_address = layout_.goal_current.address;
+  header->goal_current_length = layout_.goal_current.length;
+  header->goal_position_length = layout_.goal_position.length;
+  header->goal_address[0] = layout_.goal_position.address;
+  header->goal_length[0] = layout_.goal_position.length;
+  if (combined_write_) {
+    header->goal_address[1] = layout_.write_address;
+    header->goal_length[1] = layout_.write_length;
+    header->goal_position_offset[1] = layout_.goal_position.offset;
+    header->goal_current_offset[1] = layout_.goal_current.offset;
+  }
+  // without a goal block the end-effectors are recorded as writes of the plain items
+  if (!gripper_ids_.empty() && gripper_layout_.write_length > 0) {
+    header->goal_address[2] = gripper_layout_.write_address;
+    header->goal_length[2] = gripper_layout_.write_length;
+    header->goal_position_offset[2] = gripper_layout_.goal_position.offset;
+    header->goal_current_offset[2] = gripper_layout_.goal_current.offset;
+  }
+
+  header->joint_count = joints_.size();
+  for (uint i = 0; i < header->joint_count; i++) {
+    RecordJoint & joint = header->joints[i];
+    joints_[i].name.copy(joint.name, sizeof(joint.name) - 1);
+    joint.id = joint_ids_[i];
+    joint.current_limit = current_limits_[i];
+    joint.scale = scales_[i];
+  }
+
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "Recording the bus to %s, %lu records", path.c_str(),
+    static_cast<unsigned long>(capacity));
+  return return_type::OK;
+}
+
+bool DynamixelHardware::transmit_sync_write(
+  const uint16_t address, const uint16_t length, const uint8_t * params, const std::size_t count)
+{
+  const std::size_t size = use_protocol1_ ? protocol1_.sync_write(address, length, params, count)
+                                          : protocol_.sync_write(address, length, params, count);
+  const uint8_t * packet = use_protocol1_ ? protocol1_.tx() : protocol_.tx();
+  const auto deadline = std::chrono::steady_clock::now() + serial_port_.transfer_time(size) +
+                        kWriteMargin;
+  if (size == 0 || !serial_port_.write(packet, size, deadline)) {
+    RCLCPP_ERROR(
+      rclcpp::get_logger(kDynamixelHardware), "Failed to send the sync write to address %d",
+      address);
+    if (serial_port_.lost()) {
+      start_reconnect();
+    }
+    return false;
+  }
+  stats_bytes_ += size;
+  return true;
+}
+
+void DynamixelHardware::send_sync_write(
+  const uint16_t address, const uint16_t length, uint8_t * params, const std::size_t count)
+{
+  if (count == 0 || reconnecting_) {
+    // every servo of the group is evicted, or the port belongs to the reconnect thread
+    return;
+  }
+  if (replay_.is_open()) {
+    const uint64_t differences = replay_.mismatched_writes() + replay_.unrecorded_writes();
+    if (
+      !replay_.compare_write(address, length, params, count) &&
+      differences < kReplayReportedWrites) {
+      RCLCPP_WARN(
+        rclcpp::get_logger(kDynamixelHardware),
+        "Sync write of %d bytes to address %d differs from the recording", length, address);
+    }
+    return;
+  }
+
+  transmit_sync_write(address, length, params, count);
+  stats_writes_++;
+  if (recorder_.is_open()) {
+    recorder_.append(RecordKind::SyncWrite, address, length, params, count);
+  }
+}
+
+return_type DynamixelHardware::write_goal_current()
+{
+  const RegisterItem & item = layout_.goal_current;
+  std::size_t count = 0;
+  for (const auto & group : arm_groups_) {
+    count = (this->*group.encode_current)(group, count);
+  }
+  send_sync_write(item.address, item.length, write_params_.data(), count);
+
+  return return_type::OK;
+}
+
+return_type DynamixelHardware::write_goal_pwm()
+{
+  const RegisterItem & item = layout_.goal_pwm;
+  std::size_t count = 0;
+  for (auto i : arm_indices_) {
+    if (evicted_[i]) {
+      continue;
+    }
+    uint8_t * param = &write_params_[count++ * (1 + item.length)];
+    param[0] = joint_ids_[i];
+    const int32_t limit = pwm_limits_[i];
+    // the joints no controller drives are held at a duty cycle of 0
+    const double pwm = std::isnan(joints_[i].pwm) ? 0.0 : joints_[i].pwm;
+    const int32_t value = static_cast<int32_t>(std::round(pwm * kPwmValuePerPercent));
+    set_value(param + 1, item.length, std::max(-limit, std::min(limit, value)));
+  }
+  send_sync_write(item.address, item.length, write_params_.data(), count);
+
+  return return_type::OK;
+}
+
+return_type DynamixelHardware::write_goal_block(
+  const RegisterLayout & layout, const std::vector<std::size_t> & indices,
+  std::vector<uint8_t> & params, const bool interpolate)
+{
+  // Goal_Position, Profile_Velocity, Profile_Acceleration and Goal_Current in one sync write
+  if (interpolate && !update_profiles(indices)) {
+    // the servos are still interpolating towards the last goals
+    return return_type::OK;
+  }
+  // a zero profile means no limit, so interpolated profiles are at least one unit
+  const int32_t min_profile = interpolate ? 1 : 0;
+  std::size_t count = 0;
+  for (auto i : indices) {
+    if (evicted_[i]) {
+      continue;
+    }
+    uint8_t * param = &params[count++ * (1 + layout.write_length)];
+    param[0] = joint_ids_[i];
+    // items the servos do not have are zero length
+    const double position = joints_[i].command.position;
+    set_value(
+      param + 1 + layout.goal_position.offset, layout.goal_position.length,
+      extended_position_[i] ? from_radian(scales_[i], multi_turn_[i], position)
+                            : from_radian(scales_[i], position));
+    set_value(
+      param + 1 + layout.profile_velocity.offset, layout.profile_velocity.length,
+      std::max(min_profile, from_velocity(scales_[i], std::abs(joints_[i].profile.velocity))));
+    set_value(
+      param + 1 + layout.profile_acceleration.offset, layout.profile_acceleration.length,
+      std::max(
+        min_profile, static_cast<int32_t>(std::round(
+                       std::abs(joints_[i].profile.acceleration) / kProfileAccelerationUnit))));
+    const int32_t limit = current_limits_[i];
+    const int32_t current = from_current(scales_[i], joints_[i].profile.current);
+    set_value(
+      param + 1 + layout.goal_current.offset, layout.goal_current.length,
+      std::max(-limit, std::min(limit, current)));
+  }
+  send_sync_write(layout.write_address, layout.write_length, params.data(), count);
+
+  return return_type::OK;
+}
+
+void DynamixelHardware::configure_gripper_block()
+{
+  const RecordFileHeader * recorded = replay_.header();
+  if (recorded != nullptr && recorded->goal_address[2] == 0) {
+    // the recording has the end-effectors' Goal_Position and Goal_Current as plain writes
+    gripper_layout_ = RegisterLayout();
+    gripper_layout_.goal_position = layout_.goal_position;
+    gripper_layout_.goal_current = layout_.goal_current;
+  } else if (recorded != nullptr) {
+    // the end-effector goal block of the recording
+    gripper_layout_ = RegisterLayout();
+    gripper_layout_.write_address = recorded->goal_address[2];
+    gripper_layout_.write_length = recorded->goal_length[2];
+    gripper_layout_.goal_position = RegisterItem{
+      kGoalPositionItem, 0, recorded->goal_position_length, recorded->goal_position_offset[2]};
+    gripper_layout_.goal_current = RegisterItem{
+      kGoalCurrentItem, 0, recorded->goal_current_length, recorded->goal_current_offset[2]};
+  } else if (combined_write_) {
+    // the goal block of the indirect entries already has both
+    gripper_layout_ = layout_;
+  } else {
+    // Goal_Position and Goal_Current in two sync writes. A span of both would also write the
+    // Goal_Velocity and the profiles between them on X series, which are not commanded here.
+    gripper_layout_ = RegisterLayout();
+    gripper_layout_.goal_position = layout_.goal_position;
+    gripper_layout_.goal_current = layout_.goal_current;
+  }
+  const uint16_t param_length = std::max<uint16_t>(
+    {gripper_layout_.write_length, gripper_layout_.goal_position.length,
+     gripper_layout_.goal_current.length});
+  gripper_params_.assign(gripper_ids_.size() * (1 + param_length), 0);
+
+  const auto & parameters = info_.hardware_parameters;
+  if (parameters.find("gripper_rate") != parameters.end()) {
+    gripper_period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1.0 / std::stod(parameters.at("gripper_rate"))));
+  }
+  if (!gripper_ids_.empty() && gripper_layout_.write_length > 0) {
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware),
+      "Gripper block: %d bytes from address %d for %zu end-effectors", gripper_layout_.write_length,
+      gripper_layout_.write_address, gripper_ids_.size());
+  } else if (!gripper_ids_.empty()) {
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware),
+      "Gripper writes: Goal_Current and Goal_Position for %zu end-effectors",
+      gripper_ids_.size());
+  }
+}
+
+return_type DynamixelHardware::write_gripper_goals()
+{
+  if (gripper_layout_.write_length > 0) {
+    return write_goal_block(gripper_layout_, gripper_indices_, gripper_params_, false);
+  }
+
+  // the current first, so that the move to the new position is already limited by it
+  const RegisterItem & current = gripper_layout_.goal_current;
+  std::size_t count = 0;
+  if (current.length > 0) {
+    for (auto i : gripper_indices_) {
+      if (evicted_[i]) {
+        continue;
+      }
+      uint8_t * param = &gripper_params_[count++ * (1 + current.length)];
+      param[0] = joint_ids_[i];
+      const int32_t limit = current_limits_[i];
+      const int32_t value = from_current(scales_[i], joints_[i].profile.current);
+      set_value(param + 1, current.length, std::max(-limit, std::min(limit, value)));
+    }
+    send_sync_write(current.address, current.length, gripper_params_.data(), count);
+  }
+
+  const RegisterItem & position = gripper_layout_.goal_position;
+  count = 0;
+  for (auto i : gripper_indices_) {
+    if (evicted_[i]) {
+      continue;
+    }
+    uint8_t * param = &gripper_params_[count++ * (1 + position.length)];
+    param[0] = joint_ids_[i];
+    set_value(param + 1, position.length, from_radian(scales_[i], joints_[i].command.position));
+  }
+  send_sync_write(position.address, position.length, gripper_params_.data(), count);
+
+  return return_type::OK;
+}
+
+void DynamixelHardware::configure_groups()
+{
+  std::vector<std::size_t> indices(joints_.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  read_groups_ = make_groups(indices);
+  arm_groups_ = make_groups(arm_indices_);
+  for (const auto & group : read_groups_) {
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware), "%zu joints converted as %s series%s",
+      group.indices.size(), group.series, group.extended ? " in extended position mode" : "");
+  }
+}
+
+return_type DynamixelHardware::configure_multi_turn()
+{
+  multi_turn_.assign(joints_.size(), MultiTurnPosition());
+  for (uint i = 0; i < joints_.size(); i++) {
+    if (!extended_position_[i]) {
+      continue;
+    }
+    // models with extended position mode have a full turn centered on zero_position
+    const ValueScale & scale = scales_[i];
+    const double half_turn = scale.max_position_ratio * (scale.zero_position - 1);
+    if (std::abs(half_turn - M_PI) > 1e-3) {
+      RCLCPP_FATAL(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] extended_position needs a full turn",
+        joint_ids_[i]);
+      return return_type::ERROR;
+    }
+    multi_turn_[i].turn = static_cast<int32_t>(2 * scale.zero_position);
+    multi_turn_[i].ratio = 2.0 * M_PI / multi_turn_[i].turn;
+  }
+  return return_type::OK;
+}
+
+std::vector<DynamixelHardware::JointGroup> DynamixelHardware::make_groups(
+  const std::vector<std::size_t> & indices) const
+{
+  // the specialized codecs in order of preference, the generic one takes the rest
+  std::vector<JointGroup> groups = {
+    make_group<SeriesCodec<XSeries, true>>(),
+    make_group<SeriesCodec<XSeries, false>>(),
+    make_group<SeriesCodec<MX2Series, true>>(),
+    make_group<SeriesCodec<MX2Series, false>>(),
+    make_group<SeriesCodec<MX1Series, false>>(),
+    make_group<SeriesCodec<AXSeries, false>>(),
+    make_group<GenericCodec>(),
+  };
+  // the same again for the joints in extended position mode
+  const std::size_t candidates = groups.size();
+  for (std::size_t k = 0; k < candidates; k++) {
+    groups.push_back(groups[k]);
+    groups.back().extended = true;
+  }
+  for (auto i : indices) {
+    for (std::size_t k = 0; k < candidates; k++) {
+      if (groups[k].matches(layout_, scales_[i])) {
+        groups[extended_position_[i] ? candidates + k : k].indices.push_back(i);
+        break;
+      }
+    }
+  }
+  groups.erase(
+    std::remove_if(
+      groups.begin(), groups.end(),
+      [](const JointGroup & group) { return group.indices.empty(); }),
+    groups.end());
+  return groups;
+}
+
+template<typename Codec>
+DynamixelHardware::JointGroup DynamixelHardware::make_group()
+{
+  JointGroup group;
+  group.series = Codec::kName;
+  group.matches = &Codec::matches;
+  group.decode = &DynamixelHardware::decode_group<Codec>;
+  group.encode_position = &DynamixelHardware::encode_position_group<Codec>;
+  group.encode_velocity = &DynamixelHardware::encode_velocity_group<Codec>;
+  group.encode_current = &DynamixelHardware::encode_current_group<Codec>;
+  return group;
+}
+
+template<typename Codec>
+void DynamixelHardware::decode_group(const JointGroup & group)
+{
+  for (auto i : group.indices) {
+    if (!read_received_[i]) {
+      continue;
+    }
+    JointValue & state = joints_[i].state;
+    Codec::decode(
+      &read_data_[i * layout_.read_length], layout_, scales_[i], state.position, state.velocity,
+      state.effort);
+  }
+  if (!group.extended) {
+    return;
+  }
+  const RegisterItem & item = layout_.present_position;
+  for (auto i : group.indices) {
+    if (!read_received_[i]) {
+      continue;
+    }
+    const uint8_t * data = &read_data_[i * layout_.read_length];
+    unwrap(multi_turn_[i], get_value(data + item.offset, item.length), item.length);
+    joints_[i].state.position = to_radian(scales_[i], multi_turn_[i]);
+  }
+}
+
+template<typename Codec>
+std::size_t DynamixelHardware::encode_position_group(const JointGroup & group, std::size_t count)
+{
+  const uint8_t length = layout_.goal_position.length;
+  for (auto i : group.indices) {
+    if (evicted_[i]) {
+      continue;
+    }
+    uint8_t * param = &write_params_[count++ * (1 + length)];
+    param[0] = joint_ids_[i];
+    if (group.extended) {
+      set_value(
+        param + 1, length, from_radian(scales_[i], multi_turn_[i], joints_[i].command.position));
+    } else {
+      Codec::encode_position(param + 1, layout_, scales_[i], joints_[i].command.position);
+    }
+  }
+  return count;
+}
+
+template<typename Codec>
+std::size_t DynamixelHardware::encode_velocity_group(const JointGroup & group, std::size_t count)
+{
+  const uint8_t length = layout_.goal_velocity.length;
+  for (auto i : group.indices) {
+    if (evicted_[i]) {
+      continue;
+    }
+    uint8_t * param = &write_params_[count++ * (1 + length)];
+    param[0] = joint_ids_[i];
+    Codec::encode_velocity(param + 1, layout_, scales_[i], joints_[i].command.velocity);
+  }
+  return count;
+}
+
+template<typename Codec>
+std::size_t DynamixelHardware::encode_current_group(const JointGroup & group, std::size_t count)
+{
+  const uint8_t length = layout_.goal_current.length;
+  for (auto i : group.indices) {
+    if (evicted_[i]) {
+      continue;
+    }
+    uint8_t * param = &write_params_[count++ * (1 + length)];
+    param[0] = joint_ids_[i];
+    Codec::encode_current(
+      param + 1, layout_, scales_[i], joints_[i].command.effort, current_limits_[i]);
+  }
+  return count;
+}
+
+std::size_t DynamixelHardware::sync_read(
+  const bool clamp_timeout, const std::chrono::steady_clock::time_point deadline)
+{
+  if (use_protocol1_) {
+    return legacy_read(clamp_timeout, deadline);
+  }
+
+  read_params_.clear();
+  for (uint i = 0; i < joints_.size(); i++) {
+    if (read_pending(i)) {
+      read_params_.push_back(joint_ids_[i]);
+    }
+  }
+  // every servo is evicted and none is probed
+  if (read_params_.empty()) {
+    return 0;
+  }
+
+  // the retries are plain sync reads, where a missing servo does not cost the others
+  const bool fast = fast_sync_read_ && !clamp_timeout;
+  const std::size_t size = protocol_.sync_read(
+    layout_.read_address, layout_.read_length, read_params_.data(), read_params_.size(), fast);
+  serial_port_.flush_input();
+  protocol_.clear_rx();
+  // The answers are due once the instruction and the status packets went over the line, plus
+  // the return delays and the USB latency. Retries also end with the cycle budget.
+  const std::size_t response_size =
+    (kStatusPacketOverhead + layout_.read_length) * read_params_.size();
+  auto response_deadline = std::chrono::steady_clock::now() +
+                           serial_port_.transfer_time(size + response_size) + response_margin_;
+  if (clamp_timeout) {
+    response_deadline = std::min(response_deadline, deadline);
+  }
+  if (!serial_port_.write(protocol_.tx(), size, response_deadline)) {
+    RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "Failed to send the sync read");
+    return 0;
+  }
+  stats_bytes_ += size;
+
+  // once every requested servo has a learned timeout, the slowest of them ends the wait
+  const Transaction transaction = fast            ? Transaction::FastSyncRead
+                                  : clamp_timeout ? Transaction::SyncReadRetry
+                                                  : Transaction::SyncRead;
+  const auto sent = std::chrono::steady_clock::now();
+  const auto learned = pending_timeout(transaction);
+  const bool learned_deadline = learned.count() > 0 && sent + learned < response_deadline;
+  if (learned_deadline) {
+    response_deadline = sent + learned;
+  }
+
+  std::size_t received = 0;
+  const auto accept = [this, &received, transaction, sent](
+                        const uint8_t id, const uint8_t error, const uint8_t * data,
+                        const uint16_t length) {
+    if (!(error & 0x7f) && store_read(transaction, sent, id, data, length)) {
+      received++;
+    }
+  };
+
+  StatusPacket status;
+  while (received < read_params_.size()) {
+    if (!protocol_.next_status(status)) {
+      std::size_t available = 0;
+      uint8_t * space = protocol_.rx_space(available);
+      const ssize_t count = serial_port_.read(space, available, response_deadline);
+      if (count <= 0) {
+        // the deadline passed or the port failed
+        break;
+      }
+      protocol_.received(count);
+      continue;
+    }
+
+    stats_bytes_ += kStatusPacketOverhead + status.length;
+    if (fast && status.id == kBroadcastId) {
+      const std::size_t entries = Protocol2::fast_sync_count(status, layout_.read_length);
+      for (std::size_t k = 0; k < entries; k++) {
+        const uint8_t * entry = Protocol2::fast_sync_entry(status, layout_.read_length, k);
+        accept(entry[1], entry[0], entry + 2, layout_.read_length);
+      }
+    } else {
+      accept(status.id, status.error, status.params, status.length);
+    }
+  }
+  if (learned_deadline && !serial_port_.lost()) {
+    count_misses(transaction);
+  }
+
+  return received;
+}
+
+std::size_t DynamixelHardware::legacy_read(
+  const bool clamp_timeout, const std::chrono::steady_clock::time_point deadline)
+{
+  read_params_.clear();
+  for (uint i = 0; i < joints_.size(); i++) {
+    if (read_pending(i)) {
+      read_params_.push_back(joint_ids_[i]);
+    }
+  }
+  if (read_params_.empty()) {
+    return 0;
+  }
+  serial_port_.flush_input();
+  protocol1_.clear_rx();
+  const std::size_t status_size = kProtocol1PacketOverhead + layout_.read_length;
+
+  if (bulk_read_ && !clamp_timeout) {
+    bulk_entries_.clear();
+    for (auto id : read_params_) {
+      bulk_entries_.push_back(BulkEntry{id, layout_.read_address, layout_.read_length});
+    }
+    const std::size_t size = protocol1_.bulk_read(bulk_entries_.data(), bulk_entries_.size());
+    auto response_deadline = std::chrono::steady_clock::now() +
+                             serial_port_.transfer_time(size + status_size * read_params_.size()) +
+                             response_margin_;
+    if (size == 0 || !serial_port_.write(protocol1_.tx(), size, response_deadline)) {
+      RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "Failed to send the bulk read");
+      return 0;
+    }
+    stats_bytes_ += size;
+    const auto sent = std::chrono::steady_clock::now();
+    const auto learned = pending_timeout(Transaction::BulkRead);
+    const bool learned_deadline = learned.count() > 0 && sent + learned < response_deadline;
+    if (learned_deadline) {
+      response_deadline = sent + learned;
+    }
+    const std::size_t received =
+      receive_legacy(read_params_.size(), Transaction::BulkRead, sent, response_deadline);
+    if (learned_deadline && !serial_port_.lost()) {
+      count_misses(Transaction::BulkRead);
+    }
+    return received;
+  }
+
+  // one servo at a time, nothing but the parsing between a status packet and the next read
+  std::size_t received = 0;
+  for (auto id : read_params_) {
+    const int index = joint_index_by_id_[id];
+    if (read_received_[index]) {
+      // a late answer to the previous read
+      continue;
+    }
+    if (clamp_timeout && std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
+    const std::size_t size = protocol1_.read(id, layout_.read_address, layout_.read_length);
+    auto response_deadline = std::chrono::steady_clock::now() +
+                             serial_port_.transfer_time(size + status_size) + read_margin_;
+    if (clamp_timeout) {
+      response_deadline = std::min(response_deadline, deadline);
+    }
+    if (!serial_port_.write(protocol1_.tx(), size, response_deadline)) {
+      RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Failed to send the read", id);
+      break;
+    }
+    stats_bytes_ += size;
+    const auto sent = std::chrono::steady_clock::now();
+    const auto learned = response_timeouts_.timeout(Transaction::Read, index);
+    const bool learned_deadline = learned.count() > 0 && sent + learned < response_deadline;
+    if (learned_deadline) {
+      response_deadline = sent + learned;
+    }
+    const std::size_t answered = receive_legacy(1, Transaction::Read, sent, response_deadline);
+    received += answered;
+    if (serial_port_.lost()) {
+      break;
+    }
+    if (learned_deadline && answered == 0 && !read_received_[index]) {
+      response_timeouts_.miss(Transaction::Read, index);
+    }
+  }
+  return received;
+}
+
+std::size_t DynamixelHardware::receive_legacy(
+  const std::size_t count, const Transaction transaction,
+  const std::chrono::steady_clock::time_point sent,
+  const std::chrono::steady_clock::time_point deadline)
+{
+  std::size_t received = 0;
+  StatusPacket status;
+  while (received < count) {
+    if (!protocol1_.next_status(status)) {
+      std::size_t available = 0;
+      uint8_t * space = protocol1_.rx_space(available);
+      const ssize_t bytes = serial_port_.read(space, available, deadline);
+      if (bytes <= 0) {
+        // the deadline passed or the port failed
+        break;
+      }
+      protocol1_.received(bytes);
+      continue;
+    }
+    stats_bytes_ += kProtocol1PacketOverhead + status.length;
+    // the other error bits report the servo's condition, its data is valid
+    if (
+      !(status.error & kProtocol1CommunicationErrors) &&
+      store_read(transaction, sent, status.id, status.params, status.length)) {
+      received++;
+    }
+  }
+  return received;
+}
+
+bool DynamixelHardware::store_read(
+  const Transaction transaction, const std::chrono::steady_clock::time_point sent,
+  const uint8_t id, const uint8_t * data, const uint16_t length)
+{
+  const int index = joint_index_by_id_[id];
+  if (index < 0 || !read_pending(index) || length != layout_.read_length) {
+    return false;
+  }
+  response_timeouts_.add(transaction, index, std::chrono::steady_clock::now() - sent);
+  std::copy_n(data, layout_.read_length, &read_data_[index * layout_.read_length]);
+  read_received_[index] = true;
+  return true;
+}
+
+void DynamixelHardware::count_misses(const Transaction transaction)
+{
+  for (auto id : read_params_) {
+    const int index = joint_index_by_id_[id];
+    if (!read_received_[index]) {
+      response_timeouts_.miss(transaction, index);
+    }
+  }
+}
+
+ResponseTimeouts::Duration DynamixelHardware::pending_timeout(
+  const Transaction transaction) const
 {
+  ResponseTimeouts::Duration learned{0};
   for (uint i = 0; i < joints_.size(); i++) {
-    joints_[i].command.position = joints_[i].state.position;
-    joints_[i].command.velocity = 0.0;
-    joints_[i].command.effort = 0.0;
+    if (!read_pending(i)) {
+      continue;
+    }
+    const auto timeout = response_timeouts_.timeout(transaction, i);
+    if (timeout.count() == 0) {
+      return ResponseTimeouts::Duration::zero();
+    }
+    learned = std::max(learned, timeout);
+  }
+  return learned;
+}
+
+return_type DynamixelHardware::configure_legacy_read()
+{
+  const auto & parameters = info_.hardware_parameters;
+  const std::string method =
+    parameters.find("protocol1_read") != parameters.end() ? parameters.at("protocol1_read")
+                                                          : "auto";
+  if (method != "auto" && method != "bulk" && method != "single") {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "protocol1_read must be auto, bulk or single");
+    return return_type::ERROR;
+  }
+  // only the MX series firmware has Bulk Read in Protocol 1.0
+  const bool bulk_supported =
+    std::all_of(joint_ids_.cbegin(), joint_ids_.cend(), [this](uint8_t id) {
+      const char * model = dynamixel_workbench_.getModelName(id);
+      return model != nullptr && std::strncmp(model, "MX", 2) == 0;
+    });
+  if (method == "bulk" && !bulk_supported) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware), "Bulk read needs MX series servos only");
+    return return_type::ERROR;
+  }
+
+  // what a read cycle of the chain takes both ways, the rate it allows follows from it
+  bulk_read_ = false;
+  const double single_us = measure_read_latency();
+  double bulk_us = std::numeric_limits<double>::quiet_NaN();
+  if (bulk_supported) {
+    bulk_read_ = true;
+    bulk_us = measure_read_latency();
+  }
+  response_timeouts_.reset();
+  if (bulk_supported) {
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware),
+      "Protocol 1.0 read of %zu servos: single reads %.0f us (%.0f Hz), bulk read %.0f us "
+      "(%.0f Hz)",
+      joints_.size(), single_us, 1e6 / single_us, bulk_us, 1e6 / bulk_us);
+  } else {
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware),
+      "Protocol 1.0 read of %zu servos: single reads %.0f us (%.0f Hz)", joints_.size(),
+      single_us, 1e6 / single_us);
+  }
+
+  if (method == "single") {
+    bulk_read_ = false;
+  } else if (method == "auto") {
+    // NaN when not every servo got through
+    bulk_read_ = !std::isnan(bulk_us) && (std::isnan(single_us) || bulk_us < single_us);
+  }
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "Protocol 1.0 read: %s",
+    bulk_read_ ? "bulk" : "single");
+  return return_type::OK;
+}
+
+return_type DynamixelHardware::enable_torque(const bool enabled)
+{
+  if (enabled == torque_enabled_) {
+    return return_type::OK;
+  }
+
+  // the reconnect thread switches the torque once the port is back
+  if (!reconnecting_ || !defer_switch(enabled, control_mode_)) {
+    acknowledge_writes(true);
+    for (uint i = 0; i < joints_.size() && !reconnecting_; ++i) {
+      if (!write_register(joint_ids_[i], torque_enable_item_, enabled ? 1 : 0) && !reconnecting_) {
+        RCLCPP_FATAL(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Failed to write %s", joint_ids_[i],
+          kTorqueEnableItem);
+        acknowledge_writes(false);
+        return return_type::ERROR;
+      }
+    }
+    acknowledge_writes(false);
+    if (reconnecting_ && !defer_switch(enabled, control_mode_)) {
+      // the port went away and came back meanwhile
+      return enable_torque(enabled);
+    }
+  }
+  if (enabled) {
+    reset_command();
+  }
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "Torque %s", enabled ? "enabled" : "disabled");
+
+  torque_enabled_ = enabled;
+  return return_type::OK;
+}
+
+return_type DynamixelHardware::switch_torque(const std::vector<uint8_t> & ids, const bool enabled)
+{
+  for (auto id : ids) {
+    if (!write_register(id, torque_enable_item_, enabled ? 1 : 0)) {
+      if (!reconnecting_) {
+        RCLCPP_FATAL(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Failed to write %s", id,
+          kTorqueEnableItem);
+      }
+      return return_type::ERROR;
+    }
+  }
+  return return_type::OK;
+}
+
+ControlMode DynamixelHardware::joint_mode(const std::size_t index, const ControlMode mode) const
+{
+  if (std::find(gripper_indices_.cbegin(), gripper_indices_.cend(), index) !=
+      gripper_indices_.cend()) {
+    return ControlMode::CurrentBasedPosition;
+  }
+  return mode == ControlMode::Position && extended_position_[index]
+           ? ControlMode::ExtendedPosition
+           : mode;
+}
+
+bool DynamixelHardware::write_mode(const std::size_t index, const ControlMode mode, bool & written)
+{
+  const uint8_t id = joint_ids_[index];
+  std::array<std::pair<const RegisterItem *, int32_t>, 2> registers;
+  std::size_t count = 0;
+  if (use_protocol1_) {
+    // the position range of the models is symmetric around zero_position
+    const int32_t max_position = static_cast<int32_t>(2 * scales_[index].zero_position) - 1;
+    switch (mode) {
+      case ControlMode::Position:
+        registers = {{{&cw_angle_limit_item_, 0}, {&ccw_angle_limit_item_, max_position}}};
+        break;
+      case ControlMode::Velocity:
+        registers = {{{&cw_angle_limit_item_, 0}, {&ccw_angle_limit_item_, 0}}};
+        break;
+      case ControlMode::ExtendedPosition:
+        registers = {
+          {{&cw_angle_limit_item_, max_position}, {&ccw_angle_limit_item_, max_position}}};
+        break;
+      default:
+        return false;
+    }
+    count = 2;
+  } else {
+    const int32_t value = operating_mode(mode);
+    if (value < 0) {
+      return false;
+    }
+    registers[0] = {&operating_mode_item_, value};
+    count = 1;
+  }
+
+  written = false;
+  for (std::size_t k = 0; k < count; k++) {
+    int32_t present = 0;
+    if (!read_register(id, *registers[k].first, present)) {
+      return false;
+    }
+    if (present == registers[k].second) {
+      continue;
+    }
+    // the mode registers are in the EEPROM, which is locked while the torque is on
+    if (
+      (!written && !write_register(id, torque_enable_item_, 0)) ||
+      !write_register(id, *registers[k].first, registers[k].second)) {
+      return false;
+    }
+    written = true;
+  }
+  if (written && use_protocol1_) {
+    std::this_thread::sleep_for(kEepromWriteTime);
+  }
+  return true;
+}
+
+bool DynamixelHardware::read_register(const uint8_t id, const RegisterItem & item, int32_t & value)
+{
+  const std::size_t size = use_protocol1_ ? protocol1_.read(id, item.address, item.length)
+                                          : protocol_.read(id, item.address, item.length);
+  const uint8_t * data = nullptr;
+  if (!transact(id, size, item.length, data)) {
+    return false;
+  }
+  value = get_value(data, item.length);
+  return true;
+}
+
+bool DynamixelHardware::write_register(
+  const uint8_t id, const RegisterItem & item, const int32_t value)
+{
+  uint8_t data[4];
+  set_value(data, item.length, value);
+  const std::size_t size = use_protocol1_ ? protocol1_.write(id, item.address, data, item.length)
+                                          : protocol_.write(id, item.address, data, item.length);
+  const uint8_t * status_data = nullptr;
+  return transact(id, size, 0, status_data);
+}
+
+bool DynamixelHardware::transact(
+  const uint8_t id, const std::size_t size, const uint16_t length, const uint8_t *& data)
+{
+  serial_port_.flush_input();
+  use_protocol1_ ? protocol1_.clear_rx() : protocol_.clear_rx();
+  const auto deadline = std::chrono::steady_clock::now() +
+                        serial_port_.transfer_time(size + kStatusPacketOverhead + length) +
+                        kRegisterTimeout;
+  const uint8_t * packet = use_protocol1_ ? protocol1_.tx() : protocol_.tx();
+  if (size == 0 || !serial_port_.write(packet, size, deadline)) {
+    if (serial_port_.lost()) {
+      start_reconnect();
+    }
+    return false;
+  }
+
+  StatusPacket status;
+  while (true) {
+    if (!(use_protocol1_ ? protocol1_.next_status(status) : protocol_.next_status(status))) {
+      std::size_t available = 0;
+      uint8_t * space = use_protocol1_ ? protocol1_.rx_space(available)
+                                       : protocol_.rx_space(available);
+      const ssize_t count = serial_port_.read(space, available, deadline);
+      if (count <= 0) {
+        if (serial_port_.lost()) {
+          start_reconnect();
+        }
+        return false;
+      }
+      use_protocol1_ ? protocol1_.received(count) : protocol_.received(count);
+      continue;
+    }
+    if (status.id != id) {
+      continue;
+    }
+    // the alert and hardware error bits report the servo's condition, the instruction went through
+    const uint8_t errors = use_protocol1_ ? kProtocol1CommunicationErrors : 0x7f;
+    if ((status.error & errors) || status.length < length) {
+      return false;
+    }
+    data = status.params;
+    return true;
+  }
+}
+
+return_type DynamixelHardware::set_control_mode(const ControlMode & mode, const bool force_set)
+{
+  if (replay_.is_open()) {
+    // the recording only has the goal writes that follow
+    control_mode_ = mode;
+    return return_type::OK;
+  }
+  const char * name = control_mode_name(mode);
+  if (name == nullptr) {
+    RCLCPP_FATAL(
+      rclcpp::get_logger(kDynamixelHardware),
+      "Only position/velocity/current/PWM control are implemented");
+    return return_type::ERROR;
+  }
+
+  // the reconnect thread switches the servos once the port is back
+  if (reconnecting_ && defer_switch(torque_enabled_, mode)) {
+    if (mode != control_mode_) {
+      RCLCPP_INFO(
+        rclcpp::get_logger(kDynamixelHardware), "%s control once %s is back", name,
+        usb_port_.c_str());
+      control_mode_ = mode;
+      if (torque_enabled_) {
+        reset_bus_command();
+      }
+    }
+    return return_type::OK;
+  }
+  const return_type result = switch_control_mode(mode, force_set);
+  if (result != return_type::OK && reconnecting_) {
+    // the port went away meanwhile
+    return set_control_mode(mode, force_set);
+  }
+  return result;
+}
+
+return_type DynamixelHardware::switch_control_mode(const ControlMode & mode, const bool force_set)
+{
+  if (force_set || mode != control_mode_) {
+    const char * name = control_mode_name(mode);
+
+    // only the arm switches, the end-effectors keep holding
+    acknowledge_writes(true);
+    bool torque_enabled = torque_enabled_;
+    if (reconnecting_ || (torque_enabled && switch_torque(arm_ids_, false) != return_type::OK)) {
+      acknowledge_writes(false);
+      return return_type::ERROR;
+    }
+
+    // continuous joints take their position goals over any number of turns, in multi-turn
+    // mode on Protocol 1.0 servos
+    for (auto i : arm_indices_) {
+      bool written = false;
+      if (!write_mode(i, joint_mode(i, mode), written)) {
+        if (!reconnecting_) {
+          RCLCPP_FATAL(
+            rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Failed to set %s control",
+            joint_ids_[i], name);
+        }
+        acknowledge_writes(false);
+        return return_type::ERROR;
+      }
+    }
+    RCLCPP_INFO(rclcpp::get_logger(kDynamixelHardware), "%s control", name);
+    control_mode_ = mode;
+    // a servo may count its position within one turn again after a mode switch
+    for (auto & position : multi_turn_) {
+      position.rebase = true;
+    }
+
+    if (torque_enabled) {
+      if (switch_torque(arm_ids_, true) != return_type::OK) {
+        acknowledge_writes(false);
+        return return_type::ERROR;
+      }
+      reset_bus_command();
+    }
+  }
+
+  // set current-based position control mode for the end-effectors once, Goal_Current is sent
+  // with every position goal
+  if (force_set && !gripper_ids_.empty()) {
+    acknowledge_writes(true);
+    bool torque_enabled = torque_enabled_;
+    if (
+      reconnecting_ ||
+      (torque_enabled && switch_torque(gripper_ids_, false) != return_type::OK)) {
+      acknowledge_writes(false);
+      return return_type::ERROR;
+    }
+
+    for (auto i : gripper_indices_) {
+      bool written = false;
+      if (!write_mode(i, ControlMode::CurrentBasedPosition, written)) {
+        if (!reconnecting_) {
+          RCLCPP_FATAL(
+            rclcpp::get_logger(kDynamixelHardware),
+            "[ID:%d] Failed to set current-based position control", joint_ids_[i]);
+        }
+        acknowledge_writes(false);
+        return return_type::ERROR;
+      }
+    }
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware), "Current-based position control for gripper");
+
+    if (torque_enabled && switch_torque(gripper_ids_, true) != return_type::OK) {
+      acknowledge_writes(false);
+      return return_type::ERROR;
+    }
+  }
+  acknowledge_writes(false);
+
+  return return_type::OK;
+}
+
+void DynamixelHardware::acknowledge_writes(const bool enabled)
+{
+  const int level = enabled ? kStatusReturnAll : status_return_level_;
+  if (
+    status_return_params_.empty() || level == written_status_return_level_ || reconnecting_) {
+    return;
+  }
+  write_status_return_level(level);
+}
+
+void DynamixelHardware::write_status_return_level(const int level)
+{
+  for (uint i = 0; i < joint_ids_.size(); i++) {
+    status_return_params_[2 * i] = joint_ids_[i];
+    status_return_params_[2 * i + 1] = static_cast<uint8_t>(level);
+  }
+  transmit_sync_write(
+    status_return_item_.address, status_return_item_.length, status_return_params_.data(),
+    joint_ids_.size());
+  if (use_protocol1_) {
+    std::this_thread::sleep_for(kEepromWriteTime);
+  }
+  written_status_return_level_ = level;
+}
+
+return_type DynamixelHardware::tune_servos()
+{
+  const auto & parameters = info_.hardware_parameters;
+  const char * log = nullptr;
+  const bool keep_return_delay =
+    parameters.find("return_delay_us") != parameters.end() &&
+    parameters.at("return_delay_us") == "keep";
+  if (keep_return_delay && status_return_params_.empty()) {
+    return return_type::OK;
+  }
+
+  const double before_us = measure_read_latency();
+
+  int return_delay_us = 0;
+  int32_t return_delay = 0;
+  RegisterItem return_delay_item;
+  if (!keep_return_delay) {
+    if (parameters.find("return_delay_us") != parameters.end()) {
+      return_delay_us = std::stoi(parameters.at("return_delay_us"));
+    }
+    if (
+      return_delay_us < 0 || return_delay_us > kMaxReturnDelayUs ||
+      !find_item(return_delay_item, {kReturnDelayTimeItem})) {
+      RCLCPP_FATAL(
+        rclcpp::get_logger(kDynamixelHardware),
+        "return_delay_us must be in [0, %d] on servos with %s", kMaxReturnDelayUs,
+        kReturnDelayTimeItem);
+      return return_type::ERROR;
+    }
+    // one sync write to the EEPROM of every servo, the torque is still off
+    return_delay = static_cast<int32_t>(return_delay_us / kReturnDelayUnitUs);
+    for (uint i = 0; i < joint_ids_.size(); i++) {
+      uint8_t * param = &write_params_[i * (1 + return_delay_item.length)];
+      param[0] = joint_ids_[i];
+      set_value(param + 1, return_delay_item.length, return_delay);
+    }
+    send_sync_write(
+      return_delay_item.address, return_delay_item.length, write_params_.data(),
+      joint_ids_.size());
+    std::this_thread::sleep_for(kEepromWriteTime);
+  }
+  // Status_Return_Level is already at its value after the workbench's writes
+
+  for (auto id : joint_ids_) {
+    int32_t value = 0;
+    if (!keep_return_delay) {
+      if (!dynamixel_workbench_.itemRead(id, kReturnDelayTimeItem, &value, &log)) {
+        RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+        return return_type::ERROR;
+      }
+      if (value != return_delay) {
+        RCLCPP_FATAL(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] %s is %d, not %d", id,
+          kReturnDelayTimeItem, value, return_delay);
+        return return_type::ERROR;
+      }
+    }
+    if (!status_return_params_.empty()) {
+      if (!dynamixel_workbench_.itemRead(id, kStatusReturnLevelItem, &value, &log)) {
+        RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
+        return return_type::ERROR;
+      }
+      if (value != status_return_level_) {
+        RCLCPP_FATAL(
+          rclcpp::get_logger(kDynamixelHardware), "[ID:%d] %s is %d, not %d", id,
+          kStatusReturnLevelItem, value, status_return_level_);
+        return return_type::ERROR;
+      }
+    }
+  }
+
+  const double after_us = measure_read_latency();
+  // the response times learned so far are from before
+  response_timeouts_.reset();
+  if (!keep_return_delay) {
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware), "%s: %.0f us", kReturnDelayTimeItem,
+      return_delay * kReturnDelayUnitUs);
+  }
+  if (!status_return_params_.empty()) {
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware), "%s: %d", kStatusReturnLevelItem,
+      status_return_level_);
+  }
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "Sync read latency: %.0f us before, %.0f us after",
+    before_us, after_us);
+  return return_type::OK;
+}
+
+double DynamixelHardware::measure_read_latency()
+{
+  // long enough for any return delay, plan_bus_budget() sets the real margin afterwards
+  response_margin_ = std::chrono::microseconds(static_cast<int64_t>(
+    kMaxReturnDelayUs * joints_.size() + kUnknownUsbLatencyUs + kResponseSlackUs));
+  read_margin_ = std::chrono::microseconds(
+    static_cast<int64_t>(kMaxReturnDelayUs + kUnknownUsbLatencyUs + kResponseSlackUs));
+  std::chrono::nanoseconds total{0};
+  int complete = 0;
+  for (int k = 0; k < kLatencySamples; k++) {
+    std::fill(read_received_.begin(), read_received_.end(), false);
+    const auto start = std::chrono::steady_clock::now();
+    if (sync_read(false, start) == joints_.size()) {
+      total += std::chrono::steady_clock::now() - start;
+      complete++;
+    }
+  }
+  return complete > 0 ? std::chrono::duration<double, std::micro>(total).count() / complete
+                      : std::numeric_limits<double>::quiet_NaN();
+}
+
+return_type DynamixelHardware::reset_command()
+{
+  std::vector<Joint> & joints = streaming_ ? stream_joints_ : joints_;
+  for (uint i = 0; i < joints.size(); i++) {
+    joints[i].command.position = joints[i].state.position;
+    joints[i].command.velocity = 0.0;
+    joints[i].command.effort = 0.0;
+    joints[i].pwm = std::numeric_limits<double>::quiet_NaN();
   }
 
   for (uint i = 0; i < virtual_joints_.size(); i++) {
@@ -565,6 +3091,23 @@ return_type DynamixelHardware::reset_command()
   return return_type::OK;
 }
 
+void DynamixelHardware::reset_bus_command()
+{
+  if (!streaming_) {
+    reset_command();
+    return;
+  }
+  for (auto & joint : joints_) {
+    joint.command.position = joint.state.position;
+    joint.command.velocity = 0.0;
+    joint.command.effort = 0.0;
+    joint.pwm = std::numeric_limits<double>::quiet_NaN();
+  }
+  // the queued setpoints are from before the switch
+  setpoint_queue_.clear();
+  stream_reset_ = true;
+}
+
 }  // namespace dynamixel_hardware
 
 #include "pluginlib/class_list_macros.hpp"
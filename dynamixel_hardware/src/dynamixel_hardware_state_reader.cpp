@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <limits>
 #include <string>
 #include <vector>
@@ -38,6 +39,8 @@ constexpr const char * kPresentVelocityItem = "Present_Velocity";
 constexpr const char * kPresentSpeedItem = "Present_Speed";
 constexpr const char * kPresentCurrentItem = "Present_Current";
 constexpr const char * kPresentLoadItem = "Present_Load";
+// how often a missing state snapshot is looked for again
+constexpr std::chrono::seconds kSnapshotRetryPeriod(1);
 
 return_type DynamixelHardwareStateReader::configure(const hardware_interface::HardwareInfo & info)
 {
@@ -69,6 +72,26 @@ return_type DynamixelHardwareStateReader::configure(const hardware_interface::Ha
     return return_type::OK;
   }
 
+  if (info_.hardware_parameters.find("state_snapshot") != info_.hardware_parameters.end()) {
+    // the state comes from the DynamixelHardware that owns the bus, which may be configured
+    // after this one
+    snapshot_name_ = info_.hardware_parameters.at("state_snapshot");
+    if (
+      info_.hardware_parameters.find("snapshot_timeout_ms") !=
+      info_.hardware_parameters.end()) {
+      snapshot_timeout_ = std::chrono::milliseconds(
+        std::stoi(info_.hardware_parameters.at("snapshot_timeout_ms")));
+    }
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware), "state_snapshot: %s, timeout %ld ms",
+      snapshot_name_.c_str(),
+      static_cast<long>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(snapshot_timeout_).count()));
+    attach_snapshot();
+    status_ = hardware_interface::status::CONFIGURED;
+    return return_type::OK;
+  }
+
   auto usb_port = info_.hardware_parameters.at("usb_port");
   auto baud_rate = std::stoi(info_.hardware_parameters.at("baud_rate"));
   const char * log = nullptr;
@@ -132,32 +155,44 @@ return_type DynamixelHardwareStateReader::configure(const hardware_interface::Ha
     return return_type::ERROR;
   }
 
-  control_items_[kGoalPositionItem] = goal_position;
-  control_items_[kGoalVelocityItem] = goal_velocity;
-  control_items_[kPresentPositionItem] = present_position;
-  control_items_[kPresentVelocityItem] = present_velocity;
-  control_items_[kPresentCurrentItem] = present_current;
+  layout_.goal_position = RegisterItem{
+    goal_position->item_name, goal_position->address, goal_position->data_length, 0};
+  layout_.goal_velocity = RegisterItem{
+    goal_velocity->item_name, goal_velocity->address, goal_velocity->data_length, 0};
+  layout_.present_position = RegisterItem{
+    present_position->item_name, present_position->address, present_position->data_length, 0};
+  layout_.present_velocity = RegisterItem{
+    present_velocity->item_name, present_velocity->address, present_velocity->data_length, 0};
+  layout_.present_current = RegisterItem{
+    present_current->item_name, present_current->address, present_current->data_length, 0};
 
   if (!dynamixel_workbench_.addSyncWriteHandler(
-        control_items_[kGoalPositionItem]->address, control_items_[kGoalPositionItem]->data_length,
-        &log)) {
+        layout_.goal_position.address, layout_.goal_position.length, &log)) {
     RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
     return return_type::ERROR;
   }
 
   if (!dynamixel_workbench_.addSyncWriteHandler(
-        control_items_[kGoalVelocityItem]->address, control_items_[kGoalVelocityItem]->data_length,
-        &log)) {
+        layout_.goal_velocity.address, layout_.goal_velocity.length, &log)) {
     RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
     return return_type::ERROR;
   }
 
-  uint16_t start_address = std::min(
-    control_items_[kPresentPositionItem]->address, control_items_[kPresentCurrentItem]->address);
-  uint16_t read_length = control_items_[kPresentPositionItem]->data_length +
-                         control_items_[kPresentVelocityItem]->data_length +
-                         control_items_[kPresentCurrentItem]->data_length + 2;
-  if (!dynamixel_workbench_.addSyncReadHandler(start_address, read_length, &log)) {
+  // read the contiguous span covering the present items
+  layout_.read_address = std::min(
+    {layout_.present_position.address, layout_.present_velocity.address,
+     layout_.present_current.address});
+  layout_.read_length =
+    std::max(
+      {layout_.present_position.address + layout_.present_position.length,
+       layout_.present_velocity.address + layout_.present_velocity.length,
+       layout_.present_current.address + layout_.present_current.length}) -
+    layout_.read_address;
+  layout_.present_position.offset = layout_.present_position.address - layout_.read_address;
+  layout_.present_velocity.offset = layout_.present_velocity.address - layout_.read_address;
+  layout_.present_current.offset = layout_.present_current.address - layout_.read_address;
+  if (!dynamixel_workbench_.addSyncReadHandler(
+        layout_.read_address, layout_.read_length, &log)) {
     RCLCPP_FATAL(rclcpp::get_logger(kDynamixelHardware), "%s", log);
     return return_type::ERROR;
   }
@@ -229,6 +264,10 @@ return_type DynamixelHardwareStateReader::read()
     return return_type::OK;
   }
 
+  if (!snapshot_name_.empty()) {
+    return read_snapshot();
+  }
+
   std::vector<uint8_t> ids(info_.joints.size(), 0);
   std::vector<int32_t> positions(info_.joints.size(), 0);
   std::vector<int32_t> velocities(info_.joints.size(), 0);
@@ -244,22 +283,21 @@ return_type DynamixelHardwareStateReader::read()
 
   if (!dynamixel_workbench_.getSyncReadData(
         kPresentPositionVelocityCurrentIndex, ids.data(), ids.size(),
-        control_items_[kPresentCurrentItem]->address,
-        control_items_[kPresentCurrentItem]->data_length, currents.data(), &log)) {
+        layout_.present_current.address, layout_.present_current.length, currents.data(), &log)) {
     RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "%s", log);
   }
 
   if (!dynamixel_workbench_.getSyncReadData(
         kPresentPositionVelocityCurrentIndex, ids.data(), ids.size(),
-        control_items_[kPresentVelocityItem]->address,
-        control_items_[kPresentVelocityItem]->data_length, velocities.data(), &log)) {
+        layout_.present_velocity.address, layout_.present_velocity.length, velocities.data(),
+        &log)) {
     RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "%s", log);
   }
 
   if (!dynamixel_workbench_.getSyncReadData(
         kPresentPositionVelocityCurrentIndex, ids.data(), ids.size(),
-        control_items_[kPresentPositionItem]->address,
-        control_items_[kPresentPositionItem]->data_length, positions.data(), &log)) {
+        layout_.present_position.address, layout_.present_position.length, positions.data(),
+        &log)) {
     RCLCPP_ERROR(rclcpp::get_logger(kDynamixelHardware), "%s", log);
   }
 
@@ -274,6 +312,11 @@ return_type DynamixelHardwareStateReader::read()
 
 return_type DynamixelHardwareStateReader::write()
 {
+  if (!snapshot_name_.empty()) {
+    // read-only, the commands belong to the hardware that owns the bus
+    return return_type::OK;
+  }
+
   for (auto & joint : joints_) {
     joint.state.position = joint.command.position;
   }
@@ -281,6 +324,100 @@ return_type DynamixelHardwareStateReader::write()
   return return_type::OK;
 }
 
+bool DynamixelHardwareStateReader::attach_snapshot()
+{
+  snapshot_attach_time_ = std::chrono::steady_clock::now();
+  std::string error;
+  if (!snapshot_.attach(snapshot_name_, error)) {
+    RCLCPP_WARN(rclcpp::get_logger(kDynamixelHardware), "%s, retrying", error.c_str());
+    return false;
+  }
+
+  const uint32_t joint_count = snapshot_.header()->joint_count;
+  snapshot_joints_.assign(joint_count, SnapshotJoint());
+  snapshot_index_.assign(joints_.size(), -1);
+  for (uint i = 0; i < joints_.size(); i++) {
+    for (uint32_t j = 0; j < joint_count; j++) {
+      if (snapshot_.joints()[j].id == joint_ids_[i]) {
+        snapshot_index_[i] = j;
+      }
+    }
+    if (snapshot_index_[i] < 0) {
+      RCLCPP_WARN(
+        rclcpp::get_logger(kDynamixelHardware), "[ID:%d] Not in state snapshot %s", joint_ids_[i],
+        snapshot_name_.c_str());
+    }
+  }
+  RCLCPP_INFO(
+    rclcpp::get_logger(kDynamixelHardware), "Attached to state snapshot %s with %u joints",
+    snapshot_name_.c_str(), joint_count);
+  return true;
+}
+
+return_type DynamixelHardwareStateReader::read_snapshot()
+{
+  const auto now = std::chrono::steady_clock::now();
+  if (
+    !snapshot_.is_open() &&
+    (now - snapshot_attach_time_ < kSnapshotRetryPeriod || !attach_snapshot())) {
+    return return_type::OK;
+  }
+
+  SnapshotHeader header;
+  if (!snapshot_.load(header, snapshot_joints_.data(), snapshot_joints_.size())) {
+    // keep the previous state, the writer will be done by the next cycle
+    return return_type::OK;
+  }
+  // The hardware publishes on the same steady clock. When it stops, it may be reconnecting,
+  // gone, or configured again with a new segment under the name.
+  const auto age = now.time_since_epoch() - std::chrono::nanoseconds(header.monotonic_ns);
+  if (header.cycle == 0 || age > snapshot_timeout_) {
+    mark_stale();
+    if (now - snapshot_check_time_ >= kSnapshotRetryPeriod) {
+      snapshot_check_time_ = now;
+      if (snapshot_.replaced()) {
+        RCLCPP_WARN(
+          rclcpp::get_logger(kDynamixelHardware), "State snapshot %s was replaced, attaching again",
+          snapshot_name_.c_str());
+        snapshot_.close();
+        attach_snapshot();
+      }
+    }
+    return return_type::OK;
+  }
+  if (snapshot_stale_) {
+    snapshot_stale_ = false;
+    RCLCPP_INFO(
+      rclcpp::get_logger(kDynamixelHardware), "Receiving state snapshot %s",
+      snapshot_name_.c_str());
+  }
+  for (uint i = 0; i < joints_.size(); i++) {
+    if (snapshot_index_[i] >= 0) {
+      const SnapshotJoint & joint = snapshot_joints_[snapshot_index_[i]];
+      joints_[i].state.position = joint.position;
+      joints_[i].state.velocity = joint.velocity;
+      joints_[i].state.effort = joint.effort;
+    }
+  }
+
+  return return_type::OK;
+}
+
+void DynamixelHardwareStateReader::mark_stale()
+{
+  if (!snapshot_stale_) {
+    RCLCPP_WARN(
+      rclcpp::get_logger(kDynamixelHardware), "State snapshot %s is not updated, state is stale",
+      snapshot_name_.c_str());
+  }
+  snapshot_stale_ = true;
+  for (auto & joint : joints_) {
+    joint.state.position = std::numeric_limits<double>::quiet_NaN();
+    joint.state.velocity = std::numeric_limits<double>::quiet_NaN();
+    joint.state.effort = std::numeric_limits<double>::quiet_NaN();
+  }
+}
+
 return_type DynamixelHardwareStateReader::enable_torque(const bool enabled)
 {
   const char * log = nullptr;
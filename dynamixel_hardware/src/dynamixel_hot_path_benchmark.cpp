@@ -0,0 +1,283 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the host CPU time of the hot-path stages of read() and write() against a mocked
+// bus that answers every sync read from memory, so that the serial line and the servos do not
+// count. Prints one JSON object with the ns per cycle of every stage and joint count:
+//   dynamixel_hot_path_benchmark [CYCLES]
+//
+// decode   sync read packet, status packet parsing into the read block
+// convert  read block to position, velocity and effort of every joint with the generic codec
+// convert_series  the same with the X series codec the joints are grouped to
+// command  goal positions to a sync write packet with the X series codec
+// cycle    decode, convert_series and command
+//
+// The stages run the codecs and the packet layer of the hardware. It exits with 1 when the
+// joints do not match the X series codec or the two codecs disagree, so that it doubles as a
+// test of the kernels.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "dynamixel_hardware/protocol2.hpp"
+#include "dynamixel_hardware/register_layout.hpp"
+#include "dynamixel_hardware/servo_series.hpp"
+
+namespace
+{
+using dynamixel_hardware::Protocol2;
+using dynamixel_hardware::StatusPacket;
+using dynamixel_hardware::RegisterLayout;
+using dynamixel_hardware::ValueScale;
+using dynamixel_hardware::XSeries;
+using XCodec = dynamixel_hardware::SeriesCodec<XSeries, true>;
+using dynamixel_hardware::GenericCodec;
+
+// the indirect read block of Present_Position, Present_Velocity and Present_Current of X series
+constexpr uint16_t kReadAddress = 224;
+constexpr uint16_t kReadLength = 10;
+constexpr uint16_t kGoalPositionAddress = 116;
+constexpr uint16_t kGoalPositionLength = 4;
+
+// Holds the status packets of every id and hands them out after each sync read.
+class MockBus
+{
+public:
+  explicit MockBus(const std::size_t joints)
+  {
+    for (std::size_t k = 0; k < joints; k++) {
+      std::vector<uint8_t> packet = {0xff, 0xff, 0xfd, 0x00, static_cast<uint8_t>(k + 1),
+                                     kReadLength + 4, 0x00, 0x55, 0x00};
+      for (uint16_t i = 0; i < kReadLength; i++) {
+        packet.push_back(static_cast<uint8_t>(k * 7 + i));
+      }
+      const uint16_t crc = dynamixel_hardware::update_crc(0, packet.data(), packet.size());
+      packet.push_back(crc & 0xff);
+      packet.push_back(crc >> 8);
+      responses_.insert(responses_.end(), packet.begin(), packet.end());
+    }
+  }
+
+  void write(const uint8_t * packet, const std::size_t size)
+  {
+    if (size > 7 && packet[7] == dynamixel_hardware::kInstructionSyncRead) {
+      position_ = 0;
+    }
+    written_ += size;
+  }
+
+  std::size_t read(uint8_t * data, const std::size_t size)
+  {
+    const std::size_t count = std::min(size, responses_.size() - position_);
+    std::copy_n(&responses_[position_], count, data);
+    position_ += count;
+    return count;
+  }
+
+  std::size_t written() const { return written_; }
+
+private:
+  std::vector<uint8_t> responses_;
+  std::size_t position_{0};
+  std::size_t written_{0};
+};
+
+// The buffers of read() and write() for a number of joints, like DynamixelHardware keeps them.
+struct HotPath
+{
+  explicit HotPath(const std::size_t joints)
+  : bus(joints),
+    ids(joints),
+    scales(joints),
+    read_data(joints * kReadLength),
+    positions(joints),
+    velocities(joints),
+    efforts(joints),
+    goals(joints),
+    write_params(joints * (1 + kGoalPositionLength))
+  {
+    // the layout configure_read_block() maps for the X series
+    layout.read_address = kReadAddress;
+    layout.read_length = kReadLength;
+    layout.present_position = {"Present_Position", 132, 4, XCodec::kPositionOffset};
+    layout.present_velocity = {"Present_Velocity", 128, 4, XCodec::kVelocityOffset};
+    layout.present_current = {"Present_Current", 126, 2, XCodec::kCurrentOffset};
+    layout.goal_position = {"Goal_Position", kGoalPositionAddress, kGoalPositionLength, 0};
+    layout.goal_velocity = {"Goal_Velocity", 104, 4, 0};
+    layout.goal_current = {"Goal_Current", 102, 2, 0};
+    for (std::size_t k = 0; k < joints; k++) {
+      ids[k] = k + 1;
+      // XM430-W350, as make_value_scale() computes it from the model info
+      scales[k].zero_position = XSeries::kZeroPosition;
+      scales[k].max_position_ratio = XSeries::kMaxPositionRatio;
+      scales[k].min_position_ratio = XSeries::kMinPositionRatio;
+      scales[k].velocity_unit = XSeries::kVelocityUnit;
+      scales[k].current_unit = XSeries::kCurrentUnit;
+      goals[k] = 0.1 * k - 1.0;
+    }
+    protocol.reserve(4 + write_params.size(), 1 + kReadLength);
+  }
+
+  // Whether the joints are grouped to the X series codec and it converts like the generic one.
+  bool check()
+  {
+    for (std::size_t i = 0; i < ids.size(); i++) {
+      if (!XCodec::matches(layout, scales[i])) {
+        return false;
+      }
+    }
+    convert();
+    const std::vector<double> generic[] = {positions, velocities, efforts};
+    convert_series();
+    return generic[0] == positions && generic[1] == velocities && generic[2] == efforts;
+  }
+
+  std::size_t decode()
+  {
+    std::size_t size = protocol.sync_read(kReadAddress, kReadLength, ids.data(), ids.size());
+    bus.write(protocol.tx(), size);
+    protocol.clear_rx();
+    std::size_t received = 0;
+    StatusPacket status;
+    for (std::size_t k = 0; k < ids.size();) {
+      if (protocol.next_status(status)) {
+        if (status.id >= 1 && status.id <= ids.size() && status.length == kReadLength) {
+          std::copy_n(status.params, kReadLength, &read_data[(status.id - 1) * kReadLength]);
+          received++;
+        }
+        k++;
+        continue;
+      }
+      std::size_t available = 0;
+      uint8_t * space = protocol.rx_space(available);
+      const std::size_t count = bus.read(space, available);
+      if (count == 0) {
+        break;
+      }
+      protocol.received(count);
+    }
+    return received;
+  }
+
+  void convert()
+  {
+    for (std::size_t i = 0; i < ids.size(); i++) {
+      GenericCodec::decode(
+        &read_data[i * kReadLength], layout, scales[i], positions[i], velocities[i], efforts[i]);
+    }
+  }
+
+  void convert_series()
+  {
+    for (std::size_t i = 0; i < ids.size(); i++) {
+      XCodec::decode(
+        &read_data[i * kReadLength], layout, scales[i], positions[i], velocities[i], efforts[i]);
+    }
+  }
+
+  void command()
+  {
+    for (std::size_t i = 0; i < ids.size(); i++) {
+      uint8_t * param = &write_params[i * (1 + kGoalPositionLength)];
+      param[0] = ids[i];
+      XCodec::encode_position(param + 1, layout, scales[i], goals[i]);
+    }
+    const std::size_t size = protocol.sync_write(
+      kGoalPositionAddress, kGoalPositionLength, write_params.data(), ids.size());
+    bus.write(protocol.tx(), size);
+  }
+
+  MockBus bus;
+  Protocol2 protocol;
+  std::vector<uint8_t> ids;
+  std::vector<ValueScale> scales;
+  RegisterLayout layout;
+  std::vector<uint8_t> read_data;
+  std::vector<double> positions;
+  std::vector<double> velocities;
+  std::vector<double> efforts;
+  std::vector<double> goals;
+  std::vector<uint8_t> write_params;
+};
+
+template<typename Stage>
+double measure(const int cycles, Stage stage)
+{
+  for (int i = 0; i < cycles / 10; i++) {
+    stage();
+  }
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < cycles; i++) {
+    stage();
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+           .count() /
+         cycles;
+}
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  const int cycles = argc > 1 ? std::atoi(argv[1]) : 100000;
+  if (cycles <= 0) {
+    std::fprintf(stderr, "usage: dynamixel_hot_path_benchmark [CYCLES]\n");
+    return 1;
+  }
+
+  std::printf("{\n  \"benchmark\": \"dynamixel_hot_path\",\n  \"cycles\": %d,\n", cycles);
+  std::printf("  \"results\": [");
+  const char * separator = "\n";
+  double checksum = 0.0;
+  for (std::size_t joints : {4, 8, 16, 32}) {
+    HotPath path(joints);
+    if (path.decode() != joints) {
+      std::fprintf(stderr, "\nthe mocked bus answered %zu joints wrong\n", joints);
+      return 1;
+    }
+    if (!path.check()) {
+      std::fprintf(stderr, "\nthe X series codec does not convert like the generic one\n");
+      return 1;
+    }
+
+    const struct
+    {
+      const char * name;
+      double ns;
+    } stages[] = {
+      {"decode", measure(cycles, [&]() { path.decode(); })},
+      {"convert", measure(cycles, [&]() { path.convert(); })},
+      {"convert_series", measure(cycles, [&]() { path.convert_series(); })},
+      {"command", measure(cycles, [&]() { path.command(); })},
+      {"cycle", measure(cycles, [&]() {
+         path.decode();
+         path.convert_series();
+         path.command();
+       })},
+    };
+    for (const auto & stage : stages) {
+      std::printf(
+        "%s    {\"stage\": \"%s\", \"joints\": %zu, \"ns_per_cycle\": %.1f, "
+        "\"ns_per_joint\": %.2f}",
+        separator, stage.name, joints, stage.ns, stage.ns / joints);
+      separator = ",\n";
+    }
+    // keeps the conversions from being optimized away
+    checksum += path.positions[0] + path.velocities[0] + path.efforts[0] + path.bus.written();
+  }
+  std::printf("\n  ],\n  \"checksum\": %.3f\n}\n", checksum);
+  return 0;
+}
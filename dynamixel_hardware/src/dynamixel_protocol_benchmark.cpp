@@ -0,0 +1,175 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the host CPU time of the packet handling of one bus cycle, a sync read of every
+// joint and a sync write of their goal positions, with the DynamixelSDK packet handler and
+// with Protocol2. The servos are a loopback port answering from memory, so the serial line
+// and the servos do not count:
+//   dynamixel_protocol_benchmark [CYCLES]
+
+#include <dynamixel_sdk/dynamixel_sdk.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "dynamixel_hardware/protocol2.hpp"
+
+namespace
+{
+using dynamixel_hardware::Protocol2;
+using dynamixel_hardware::StatusPacket;
+
+// the indirect read block of position, velocity and current
+constexpr uint16_t kReadAddress = 224;
+constexpr uint16_t kReadLength = 10;
+constexpr uint16_t kWriteAddress = 116;
+constexpr uint16_t kWriteLength = 4;
+
+// Answers a sync read with a status packet of every id, as fast as it is read.
+class LoopbackPort : public dynamixel::PortHandler
+{
+public:
+  explicit LoopbackPort(const std::size_t joints)
+  {
+    for (std::size_t k = 0; k < joints; k++) {
+      std::vector<uint8_t> packet = {0xff, 0xff, 0xfd, 0x00, static_cast<uint8_t>(k + 1),
+                                     kReadLength + 4, 0x00, 0x55, 0x00};
+      for (uint16_t i = 0; i < kReadLength; i++) {
+        packet.push_back(static_cast<uint8_t>(k * 7 + i));
+      }
+      const uint16_t crc = dynamixel_hardware::update_crc(0, packet.data(), packet.size());
+      packet.push_back(crc & 0xff);
+      packet.push_back(crc >> 8);
+      responses_.insert(responses_.end(), packet.begin(), packet.end());
+    }
+  }
+
+  bool openPort() override { return true; }
+  void closePort() override {}
+  void clearPort() override {}
+  void setPortName(const char *) override {}
+  char * getPortName() override { return nullptr; }
+  bool setBaudRate(const int) override { return true; }
+  int getBaudRate() override { return 4000000; }
+  int getBytesAvailable() override { return responses_.size() - position_; }
+
+  int readPort(uint8_t * packet, int length) override
+  {
+    const int count = std::min<int>(length, responses_.size() - position_);
+    std::copy_n(&responses_[position_], count, packet);
+    position_ += count;
+    return count;
+  }
+
+  int writePort(uint8_t * packet, int length) override
+  {
+    if (packet[7] == dynamixel_hardware::kInstructionSyncRead) {
+      position_ = 0;
+    }
+    return length;
+  }
+
+  void setPacketTimeout(uint16_t) override {}
+  void setPacketTimeout(double) override {}
+  bool isPacketTimeout() override { return position_ == responses_.size(); }
+
+private:
+  std::vector<uint8_t> responses_;
+  std::size_t position_{0};
+};
+
+template <typename Cycle>
+double measure(const int cycles, Cycle cycle)
+{
+  for (int i = 0; i < cycles / 10; i++) {
+    cycle();
+  }
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < cycles; i++) {
+    cycle();
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+           .count() /
+         cycles;
+}
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  const int cycles = argc > 1 ? std::atoi(argv[1]) : 100000;
+  dynamixel::PacketHandler * sdk = dynamixel::PacketHandler::getPacketHandler(2.0);
+
+  std::printf("joints,sdk_ns_per_cycle,native_ns_per_cycle\n");
+  for (std::size_t joints : {4, 8, 16, 32}) {
+    LoopbackPort port(joints);
+    std::vector<uint8_t> ids(joints);
+    std::vector<uint8_t> params(joints * (1 + kWriteLength));
+    for (std::size_t k = 0; k < joints; k++) {
+      ids[k] = k + 1;
+      params[k * (1 + kWriteLength)] = k + 1;
+    }
+    std::vector<uint8_t> data(joints * kReadLength);
+    std::size_t received = 0;
+
+    std::vector<uint8_t> rx(1024);
+    const double sdk_ns = measure(cycles, [&]() {
+      sdk->syncReadTx(&port, kReadAddress, kReadLength, ids.data(), ids.size());
+      for (std::size_t k = 0; k < joints; k++) {
+        if (sdk->rxPacket(&port, rx.data()) == COMM_SUCCESS && rx[4] >= 1 && rx[4] <= joints) {
+          std::copy_n(&rx[9], kReadLength, &data[(rx[4] - 1) * kReadLength]);
+          received++;
+        }
+      }
+      sdk->syncWriteTxOnly(&port, kWriteAddress, kWriteLength, params.data(), params.size());
+    });
+
+    Protocol2 protocol;
+    protocol.reserve(4 + params.size(), 1 + kReadLength);
+    const double native_ns = measure(cycles, [&]() {
+      std::size_t size = protocol.sync_read(kReadAddress, kReadLength, ids.data(), ids.size());
+      port.writePort(const_cast<uint8_t *>(protocol.tx()), size);
+      protocol.clear_rx();
+      StatusPacket status;
+      for (std::size_t k = 0; k < joints;) {
+        if (protocol.next_status(status)) {
+          if (status.id >= 1 && status.id <= joints && status.length == kReadLength) {
+            std::copy_n(status.params, kReadLength, &data[(status.id - 1) * kReadLength]);
+            received++;
+          }
+          k++;
+          continue;
+        }
+        std::size_t available = 0;
+        uint8_t * space = protocol.rx_space(available);
+        const int count = port.readPort(space, available);
+        if (count <= 0) {
+          break;
+        }
+        protocol.received(count);
+      }
+      size = protocol.sync_write(kWriteAddress, kWriteLength, params.data(), joints);
+      port.writePort(const_cast<uint8_t *>(protocol.tx()), size);
+    });
+
+    std::printf("%zu,%.0f,%.0f\n", joints, sdk_ns, native_ns);
+    if (received == 0) {
+      std::fprintf(stderr, "no status packet was decoded\n");
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,143 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Decodes a bus recording of DynamixelHardware (the record_file parameter) into per-joint
+// time series, one CSV line per joint and transaction:
+//   time,kind,joint,id,position,velocity,effort
+// time is in seconds from the first record; reads give the present position (rad), velocity
+// (rad/s) and current (mA), writes the goal position (rad) when they carry one.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "dynamixel_hardware/bus_recorder.hpp"
+
+namespace
+{
+using dynamixel_hardware::BusRecord;
+using dynamixel_hardware::RecordFileHeader;
+using dynamixel_hardware::RecordJoint;
+using dynamixel_hardware::RecordKind;
+
+// little-endian, sign-extended for the 2 and 4 byte items
+int32_t signed_value(const uint8_t * data, const uint8_t length)
+{
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < length; i++) {
+    value |= static_cast<uint32_t>(data[i]) << (8 * i);
+  }
+  if (length == 2) {
+    return static_cast<int16_t>(value);
+  } else if (length == 4) {
+    return static_cast<int32_t>(value);
+  }
+  return value;
+}
+
+const RecordJoint * find_joint(const RecordFileHeader & header, const uint8_t id)
+{
+  for (uint32_t i = 0; i < header.joint_count; i++) {
+    if (header.joints[i].id == id) {
+      return &header.joints[i];
+    }
+  }
+  return nullptr;
+}
+
+void decode(const RecordFileHeader & header, const BusRecord & record, const double time)
+{
+  const uint8_t * entry = record.payload;
+  for (uint8_t k = 0; k < record.count; k++, entry += 1 + record.length) {
+    const uint8_t id = entry[0];
+    const uint8_t * data = entry + 1;
+    const RecordJoint * joint = find_joint(header, id);
+    if (joint == nullptr) {
+      continue;
+    }
+
+    if (record.kind == RecordKind::SyncRead && record.address == header.read_address) {
+      const double position = dynamixel_hardware::to_radian(
+        joint->scale, signed_value(data + header.position_offset, header.position_length));
+      const double velocity = dynamixel_hardware::to_velocity(
+        joint->scale, signed_value(data + header.velocity_offset, header.velocity_length));
+      const double effort = dynamixel_hardware::to_current(
+        joint->scale, signed_value(data + header.current_offset, header.current_length));
+      std::printf(
+        "%.6f,read,%s,%d,%.6f,%.6f,%.3f\n", time, joint->name, id, position, velocity, effort);
+      continue;
+    }
+
+    for (std::size_t j = 0; j < dynamixel_hardware::kRecordGoalWrites; j++) {
+      if (
+        header.goal_address[j] != 0 && record.address == header.goal_address[j] &&
+        header.goal_position_offset[j] + header.goal_position_length <= record.length) {
+        const double position = dynamixel_hardware::to_radian(
+          joint->scale,
+          signed_value(data + header.goal_position_offset[j], header.goal_position_length));
+        std::printf("%.6f,write,%s,%d,%.6f,,\n", time, joint->name, id, position);
+        break;
+      }
+    }
+  }
+}
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  if (argc != 2) {
+    std::fprintf(stderr, "usage: %s RECORD_FILE\n", argv[0]);
+    return 2;
+  }
+
+  std::ifstream file(argv[1], std::ios::binary);
+  const std::vector<char> contents(
+    (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (contents.size() < sizeof(RecordFileHeader)) {
+    std::fprintf(stderr, "%s: not a bus recording\n", argv[1]);
+    return 1;
+  }
+  // the atomic member keeps the header from being copied, read it in place
+  const auto & header = *reinterpret_cast<const RecordFileHeader *>(contents.data());
+  if (
+    header.magic != dynamixel_hardware::kRecordMagic ||
+    header.version != dynamixel_hardware::kRecordVersion ||
+    header.header_size != sizeof(RecordFileHeader) || header.record_size != sizeof(BusRecord) ||
+    contents.size() < sizeof(RecordFileHeader) + header.capacity * sizeof(BusRecord)) {
+    std::fprintf(stderr, "%s: unknown recording format\n", argv[1]);
+    return 1;
+  }
+
+  const auto records = reinterpret_cast<const BusRecord *>(contents.data() + sizeof(header));
+  const uint64_t next = header.next.load();
+  const uint64_t first = next > header.capacity ? next - header.capacity : 0;
+  std::printf("time,kind,joint,id,position,velocity,effort\n");
+  int64_t start_ns = 0;
+  for (uint64_t index = first; index < next; index++) {
+    const BusRecord & record = records[index % header.capacity];
+    // skip a record that was being written when the recording stopped
+    if (record.index.load() != index) {
+      continue;
+    }
+    if (start_ns == 0) {
+      start_ns = record.monotonic_ns;
+    }
+    decode(header, record, (record.monotonic_ns - start_ns) * 1e-9);
+  }
+  return 0;
+}
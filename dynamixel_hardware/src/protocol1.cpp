@@ -0,0 +1,195 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamixel_hardware/protocol1.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace dynamixel_hardware
+{
+namespace
+{
+// header(2) id(1) length(1) instruction(1)
+constexpr std::size_t kIdIndex = 2;
+constexpr std::size_t kLengthIndex = 3;
+constexpr std::size_t kInstructionIndex = 4;
+constexpr std::size_t kParamIndex = 5;
+// a status packet has at least the error and the checksum
+constexpr uint8_t kMinStatusLength = 2;
+
+// the inverted sum of the id, length, instruction or error and parameters
+uint8_t checksum(const uint8_t * packet, const std::size_t end)
+{
+  uint8_t sum = 0;
+  for (std::size_t i = kIdIndex; i < end; i++) {
+    sum += packet[i];
+  }
+  return ~sum;
+}
+}  // namespace
+
+Protocol1::Protocol1() { reserve(64, 64); }
+
+void Protocol1::reserve(const std::size_t tx_params, const std::size_t rx_params)
+{
+  reserve_tx(tx_params);
+  // room for a whole status packet behind the rest of the previous one
+  const std::size_t rx_size =
+    2 * (kProtocol1PacketOverhead + std::min(rx_params, kProtocol1MaxParams));
+  if (rx_.size() < rx_size) {
+    rx_.assign(rx_size, 0);
+    clear_rx();
+  }
+}
+
+void Protocol1::reserve_tx(const std::size_t params)
+{
+  const std::size_t size = kProtocol1PacketOverhead + std::min(params, kProtocol1MaxParams);
+  if (tx_.size() >= size) {
+    return;
+  }
+  tx_.assign(size, 0);
+  tx_[0] = 0xff;
+  tx_[1] = 0xff;
+}
+
+std::size_t Protocol1::read(const uint8_t id, const uint8_t address, const uint8_t length)
+{
+  tx_[kParamIndex] = address;
+  tx_[kParamIndex + 1] = length;
+  return finish(id, kInstructionRead, 2);
+}
+
+std::size_t Protocol1::write(
+  const uint8_t id, const uint8_t address, const uint8_t * data, const uint8_t length)
+{
+  const std::size_t params = 1 + length;
+  if (params > kProtocol1MaxParams) {
+    return 0;
+  }
+  reserve_tx(params);
+  tx_[kParamIndex] = address;
+  std::copy_n(data, length, &tx_[kParamIndex + 1]);
+  return finish(id, kInstructionWrite, params);
+}
+
+std::size_t Protocol1::bulk_read(const BulkEntry * entries, const std::size_t count)
+{
+  const std::size_t params = 1 + 3 * count;
+  if (params > kProtocol1MaxParams) {
+    return 0;
+  }
+  reserve_tx(params);
+  uint8_t * param = &tx_[kParamIndex];
+  *param++ = 0x00;
+  for (std::size_t k = 0; k < count; k++, param += 3) {
+    param[0] = entries[k].length;
+    param[1] = entries[k].id;
+    param[2] = entries[k].address;
+  }
+  return finish(kBroadcastId, kInstructionBulkRead, params);
+}
+
+std::size_t Protocol1::sync_write(
+  const uint8_t address, const uint8_t length, const uint8_t * params, const std::size_t count)
+{
+  const std::size_t size = 2 + count * (1 + length);
+  if (size > kProtocol1MaxParams) {
+    return 0;
+  }
+  reserve_tx(size);
+  uint8_t * param = &tx_[kParamIndex];
+  param[0] = address;
+  param[1] = length;
+  std::copy_n(params, count * (1 + length), param + 2);
+  return finish(kBroadcastId, kInstructionSyncWrite, size);
+}
+
+std::size_t Protocol1::finish(const uint8_t id, const uint8_t instruction, const std::size_t params)
+{
+  tx_[kIdIndex] = id;
+  tx_[kLengthIndex] = params + 2;
+  tx_[kInstructionIndex] = instruction;
+  const std::size_t checksum_index = kParamIndex + params;
+  tx_[checksum_index] = checksum(tx_.data(), checksum_index);
+  return checksum_index + 1;
+}
+
+void Protocol1::clear_rx()
+{
+  rx_begin_ = 0;
+  rx_end_ = 0;
+}
+
+uint8_t * Protocol1::rx_space(std::size_t & available)
+{
+  if (rx_begin_ > 0) {
+    std::memmove(rx_.data(), &rx_[rx_begin_], rx_end_ - rx_begin_);
+    rx_end_ -= rx_begin_;
+    rx_begin_ = 0;
+  }
+  if (rx_end_ == rx_.size()) {
+    // longer than any status packet expected
+    corrupt_packets_++;
+    clear_rx();
+  }
+  available = rx_.size() - rx_end_;
+  return &rx_[rx_end_];
+}
+
+void Protocol1::received(const std::size_t count) { rx_end_ += count; }
+
+bool Protocol1::next_status(StatusPacket & status)
+{
+  while (true) {
+    // FF FF followed by an id, which is never FF
+    std::size_t begin = rx_begin_;
+    while (begin + 3 <= rx_end_ &&
+           !(rx_[begin] == 0xff && rx_[begin + 1] == 0xff && rx_[begin + 2] != 0xff)) {
+      begin++;
+    }
+    // bytes before a header are noise, the last ones may start the next header
+    rx_begin_ = begin;
+    if (rx_end_ - rx_begin_ < kInstructionIndex) {
+      return false;
+    }
+
+    const uint8_t * packet = &rx_[rx_begin_];
+    const uint8_t length = packet[kLengthIndex];
+    if (length < kMinStatusLength || kInstructionIndex + length > rx_.size()) {
+      corrupt_packets_++;
+      rx_begin_++;
+      continue;
+    }
+    const std::size_t size = kInstructionIndex + length;
+    if (rx_end_ - rx_begin_ < size) {
+      return false;
+    }
+    const std::size_t checksum_index = size - 1;
+    if (checksum(packet, checksum_index) != packet[checksum_index]) {
+      corrupt_packets_++;
+      rx_begin_++;
+      continue;
+    }
+    rx_begin_ += size;
+
+    status.id = packet[kIdIndex];
+    status.error = packet[kInstructionIndex];
+    status.params = &packet[kParamIndex];
+    status.length = length - kMinStatusLength;
+    return true;
+  }
+}
+}  // namespace dynamixel_hardware
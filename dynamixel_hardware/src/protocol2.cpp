@@ -0,0 +1,302 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamixel_hardware/protocol2.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace dynamixel_hardware
+{
+namespace
+{
+// header(4) id(1) length(2) instruction(1)
+constexpr std::size_t kIdIndex = 4;
+constexpr std::size_t kLengthIndex = 5;
+constexpr std::size_t kInstructionIndex = 7;
+constexpr std::size_t kParamIndex = 8;
+// the header, id, length, instruction and CRC around the parameters
+constexpr std::size_t kPacketOverhead = kParamIndex + 2;
+// a status packet has at least the instruction, the error and the CRC
+constexpr uint16_t kMinStatusLength = 4;
+
+std::array<uint16_t, 256> make_crc_table()
+{
+  std::array<uint16_t, 256> table{};
+  for (uint16_t i = 0; i < 256; i++) {
+    uint16_t crc = i << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1;
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+const std::array<uint16_t, 256> kCrcTable = make_crc_table();
+
+// parameters after byte stuffing in the worst case
+std::size_t stuffed_size(const std::size_t params) { return params + params / 3 + 1; }
+
+void put_word(uint8_t * data, const uint16_t value)
+{
+  data[0] = value & 0xff;
+  data[1] = value >> 8;
+}
+}  // namespace
+
+uint16_t update_crc(uint16_t crc, const uint8_t * data, const std::size_t length)
+{
+  for (std::size_t i = 0; i < length; i++) {
+    crc = (crc << 8) ^ kCrcTable[((crc >> 8) ^ data[i]) & 0xff];
+  }
+  return crc;
+}
+
+Protocol2::Protocol2() { reserve(64, 64); }
+
+void Protocol2::reserve(const std::size_t tx_params, const std::size_t rx_params)
+{
+  reserve_tx(tx_params);
+  // room for a whole status packet behind the rest of the previous one
+  const std::size_t rx_size = 2 * (kPacketOverhead + 1 + stuffed_size(rx_params));
+  if (rx_.size() < rx_size) {
+    rx_.assign(rx_size, 0);
+    clear_rx();
+  }
+}
+
+void Protocol2::reserve_tx(const std::size_t params)
+{
+  const std::size_t size = kPacketOverhead + stuffed_size(params);
+  if (tx_.size() >= size) {
+    return;
+  }
+  tx_.assign(size, 0);
+  tx_[0] = 0xff;
+  tx_[1] = 0xff;
+  tx_[2] = 0xfd;
+  tx_[3] = 0x00;
+  tx_[kIdIndex] = kBroadcastId;
+}
+
+std::size_t Protocol2::read(const uint8_t id, const uint16_t address, const uint16_t length)
+{
+  uint8_t * param = &tx_[kParamIndex];
+  put_word(param, address);
+  put_word(param + 2, length);
+  return finish(kInstructionRead, 4, id);
+}
+
+std::size_t Protocol2::write(
+  const uint8_t id, const uint16_t address, const uint8_t * data, const uint16_t length)
+{
+  const std::size_t params = 2 + length;
+  reserve_tx(params);
+  uint8_t * param = &tx_[kParamIndex];
+  put_word(param, address);
+  std::copy_n(data, length, param + 2);
+  return finish(kInstructionWrite, params, id);
+}
+
+std::size_t Protocol2::sync_read(
+  const uint16_t address, const uint16_t length, const uint8_t * ids, const std::size_t count,
+  const bool fast)
+{
+  const std::size_t params = 4 + count;
+  reserve_tx(params);
+  uint8_t * param = &tx_[kParamIndex];
+  put_word(param, address);
+  put_word(param + 2, length);
+  std::copy_n(ids, count, param + 4);
+  return finish(fast ? kInstructionFastSyncRead : kInstructionSyncRead, params);
+}
+
+std::size_t Protocol2::sync_write(
+  const uint16_t address, const uint16_t length, const uint8_t * params, const std::size_t count)
+{
+  const std::size_t size = 4 + count * (1 + length);
+  reserve_tx(size);
+  uint8_t * param = &tx_[kParamIndex];
+  put_word(param, address);
+  put_word(param + 2, length);
+  std::copy_n(params, count * (1 + length), param + 4);
+  return finish(kInstructionSyncWrite, size);
+}
+
+std::size_t Protocol2::bulk_read(const BulkEntry * entries, const std::size_t count)
+{
+  const std::size_t size = 5 * count;
+  reserve_tx(size);
+  uint8_t * param = &tx_[kParamIndex];
+  for (std::size_t k = 0; k < count; k++, param += 5) {
+    param[0] = entries[k].id;
+    put_word(param + 1, entries[k].address);
+    put_word(param + 3, entries[k].length);
+  }
+  return finish(kInstructionBulkRead, size);
+}
+
+std::size_t Protocol2::bulk_write(
+  const BulkEntry * entries, const uint8_t * data, const std::size_t count)
+{
+  std::size_t size = 0;
+  for (std::size_t k = 0; k < count; k++) {
+    size += 5 + entries[k].length;
+  }
+  reserve_tx(size);
+  uint8_t * param = &tx_[kParamIndex];
+  for (std::size_t k = 0; k < count; k++) {
+    param[0] = entries[k].id;
+    put_word(param + 1, entries[k].address);
+    put_word(param + 3, entries[k].length);
+    param = std::copy_n(data, entries[k].length, param + 5);
+    data += entries[k].length;
+  }
+  return finish(kInstructionBulkWrite, size);
+}
+
+std::size_t Protocol2::finish(const uint8_t instruction, std::size_t params, const uint8_t id)
+{
+  // FF FF FD in the parameters would read as a header and is sent as FF FF FD FD. The pattern
+  // cannot overlap itself, so it is found the same scanning from either end.
+  const std::size_t end = kParamIndex + params;
+  std::size_t stuffing = 0;
+  for (std::size_t i = kParamIndex + 2; i < end; i++) {
+    if (tx_[i] == 0xfd && tx_[i - 1] == 0xff && tx_[i - 2] == 0xff) {
+      stuffing++;
+    }
+  }
+  std::size_t from = end;
+  std::size_t to = end + stuffing;
+  while (to > from) {
+    from--;
+    if (
+      tx_[from] == 0xfd && from >= kParamIndex + 2 && tx_[from - 1] == 0xff &&
+      tx_[from - 2] == 0xff) {
+      tx_[--to] = 0xfd;
+    }
+    tx_[--to] = tx_[from];
+  }
+  params += stuffing;
+
+  tx_[kIdIndex] = id;
+  tx_[kInstructionIndex] = instruction;
+  const uint16_t length = params + 3;
+  put_word(&tx_[kLengthIndex], length);
+  const std::size_t crc_index = kParamIndex + params;
+  put_word(&tx_[crc_index], update_crc(0, tx_.data(), crc_index));
+  return crc_index + 2;
+}
+
+void Protocol2::clear_rx()
+{
+  rx_begin_ = 0;
+  rx_end_ = 0;
+}
+
+uint8_t * Protocol2::rx_space(std::size_t & available)
+{
+  if (rx_begin_ > 0) {
+    std::memmove(rx_.data(), &rx_[rx_begin_], rx_end_ - rx_begin_);
+    rx_end_ -= rx_begin_;
+    rx_begin_ = 0;
+  }
+  if (rx_end_ == rx_.size()) {
+    // longer than any status packet expected
+    corrupt_packets_++;
+    clear_rx();
+  }
+  available = rx_.size() - rx_end_;
+  return &rx_[rx_end_];
+}
+
+void Protocol2::received(const std::size_t count) { rx_end_ += count; }
+
+bool Protocol2::next_status(StatusPacket & status)
+{
+  while (true) {
+    std::size_t begin = rx_begin_;
+    while (begin + 4 <= rx_end_ &&
+           !(rx_[begin] == 0xff && rx_[begin + 1] == 0xff && rx_[begin + 2] == 0xfd &&
+             rx_[begin + 3] == 0x00)) {
+      begin++;
+    }
+    // bytes before a header are noise, the last ones may start the next header
+    rx_begin_ = begin;
+    if (rx_end_ - rx_begin_ < kParamIndex) {
+      return false;
+    }
+
+    uint8_t * packet = &rx_[rx_begin_];
+    const uint16_t length = packet[kLengthIndex] | (packet[kLengthIndex + 1] << 8);
+    if (length < kMinStatusLength || kLengthIndex + 2 + length > rx_.size()) {
+      corrupt_packets_++;
+      rx_begin_++;
+      continue;
+    }
+    const std::size_t size = kLengthIndex + 2 + length;
+    if (rx_end_ - rx_begin_ < size) {
+      return false;
+    }
+    const std::size_t crc_index = size - 2;
+    const uint16_t crc = packet[crc_index] | (packet[crc_index + 1] << 8);
+    if (
+      packet[kInstructionIndex] != kInstructionStatus ||
+      update_crc(0, packet, crc_index) != crc) {
+      corrupt_packets_++;
+      rx_begin_++;
+      continue;
+    }
+    rx_begin_ += size;
+
+    // remove the byte stuffing in place
+    std::size_t out = kParamIndex;
+    uint8_t previous[2] = {0, 0};
+    for (std::size_t in = kParamIndex; in < crc_index; in++) {
+      const uint8_t byte = packet[in];
+      packet[out++] = byte;
+      if (
+        byte == 0xfd && previous[0] == 0xff && previous[1] == 0xff && in + 1 < crc_index &&
+        packet[in + 1] == 0xfd) {
+        in++;
+        previous[0] = previous[1] = 0;
+        continue;
+      }
+      previous[1] = previous[0];
+      previous[0] = byte;
+    }
+    status.id = packet[kIdIndex];
+    status.error = packet[kParamIndex];
+    status.params = &packet[kParamIndex + 1];
+    status.length = out - kParamIndex - 1;
+    return true;
+  }
+}
+
+std::size_t Protocol2::fast_sync_count(const StatusPacket & status, const uint16_t length)
+{
+  // error, id, data and CRC per servo, the CRC of the last one is the packet's
+  const std::size_t entry = 4 + length;
+  const std::size_t size = 1 + status.length + 2;
+  return size % entry == 0 ? size / entry : 0;
+}
+
+const uint8_t * Protocol2::fast_sync_entry(
+  const StatusPacket & status, const uint16_t length, const std::size_t k)
+{
+  return status.params - 1 + k * (4 + length);
+}
+}  // namespace dynamixel_hardware
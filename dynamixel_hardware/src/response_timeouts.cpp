@@ -0,0 +1,99 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamixel_hardware/response_timeouts.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dynamixel_hardware
+{
+constexpr double ResponseTimeouts::kQuantile;
+constexpr uint32_t ResponseTimeouts::kWarmupSamples;
+constexpr uint32_t ResponseTimeouts::kMissLimit;
+
+void ResponseTimeouts::configure(
+  const std::size_t joints, const Duration min_timeout, const Duration max_timeout,
+  const Duration margin)
+{
+  histograms_.assign(joints * kTransactionCount, Histogram());
+  min_timeout_ = min_timeout;
+  max_timeout_ = max_timeout;
+  margin_ = margin;
+}
+
+void ResponseTimeouts::reset() { std::fill(histograms_.begin(), histograms_.end(), Histogram()); }
+
+ResponseTimeouts::Histogram & ResponseTimeouts::histogram(
+  const Transaction transaction, const std::size_t joint)
+{
+  return histograms_[joint * kTransactionCount + static_cast<std::size_t>(transaction)];
+}
+
+void ResponseTimeouts::add(
+  const Transaction transaction, const std::size_t joint, const Duration round_trip)
+{
+  Histogram & entry = histogram(transaction, joint);
+  const double octaves =
+    std::log2(std::max<double>(round_trip.count(), kFirstBinNs) / kFirstBinNs);
+  const std::size_t bin = std::min<std::size_t>(static_cast<std::size_t>(octaves * 8), kBins - 1);
+  entry.bins[bin]++;
+  entry.count++;
+  entry.samples++;
+  entry.misses = 0;
+  if (entry.count >= kWindow) {
+    entry.count = 0;
+    for (auto & count : entry.bins) {
+      count /= 2;
+      entry.count += count;
+    }
+  }
+  // the quantile moves slowly, a scan of the bins every few samples is enough
+  if (
+    entry.samples == kWarmupSamples ||
+    (entry.samples > kWarmupSamples && entry.samples % 16 == 0)) {
+    update_timeout(entry);
+  }
+}
+
+void ResponseTimeouts::miss(const Transaction transaction, const std::size_t joint)
+{
+  Histogram & entry = histogram(transaction, joint);
+  if (entry.timeout.count() > 0 && ++entry.misses >= kMissLimit) {
+    entry = Histogram();
+  }
+}
+
+void ResponseTimeouts::update_timeout(Histogram & histogram) const
+{
+  const uint32_t rank = static_cast<uint32_t>(std::ceil(histogram.count * kQuantile));
+  uint32_t seen = 0;
+  std::size_t bin = 0;
+  for (; bin < kBins - 1; bin++) {
+    seen += histogram.bins[bin];
+    if (seen >= rank) {
+      break;
+    }
+  }
+  // the upper edge of the bin
+  const Duration quantile(static_cast<int64_t>(kFirstBinNs * std::exp2((bin + 1) / 8.0)));
+  histogram.timeout = std::max(min_timeout_, std::min(max_timeout_, quantile + margin_));
+}
+
+ResponseTimeouts::Duration ResponseTimeouts::timeout(
+  const Transaction transaction, const std::size_t joint) const
+{
+  return histograms_[joint * kTransactionCount + static_cast<std::size_t>(transaction)].timeout;
+}
+}  // namespace dynamixel_hardware
@@ -0,0 +1,145 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamixel_hardware/serial_port.hpp"
+
+// termios2 for arbitrary baud rates, which <termios.h> cannot be included with
+#include <asm/termbits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace dynamixel_hardware
+{
+SerialPort::~SerialPort() { close(); }
+
+bool SerialPort::open(const std::string & path, const int baud_rate, std::string & error)
+{
+  close();
+  const int fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    error = "open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  struct termios2 options;
+  if (ioctl(fd, TCGETS2, &options) != 0) {
+    error = "TCGETS2 " + path + ": " + std::strerror(errno);
+    ::close(fd);
+    return false;
+  }
+  options.c_iflag = IGNBRK;
+  options.c_oflag = 0;
+  options.c_lflag = 0;
+  options.c_cflag = CS8 | CLOCAL | CREAD | BOTHER;
+  options.c_ispeed = baud_rate;
+  options.c_ospeed = baud_rate;
+  options.c_cc[VMIN] = 0;
+  options.c_cc[VTIME] = 0;
+  if (ioctl(fd, TCSETS2, &options) != 0) {
+    error = "TCSETS2 " + path + ": " + std::strerror(errno);
+    ::close(fd);
+    return false;
+  }
+
+  fd_ = fd;
+  baud_rate_ = baud_rate;
+  lost_ = false;
+  flush_input();
+  return true;
+}
+
+void SerialPort::close()
+{
+  if (fd_ < 0) {
+    return;
+  }
+  ::close(fd_);
+  fd_ = -1;
+}
+
+void SerialPort::flush_input() { ioctl(fd_, TCFLSH, TCIFLUSH); }
+
+bool SerialPort::write(
+  const uint8_t * data, const std::size_t size,
+  const std::chrono::steady_clock::time_point deadline)
+{
+  std::size_t written = 0;
+  while (written < size) {
+    const ssize_t count = ::write(fd_, data + written, size - written);
+    if (count > 0) {
+      written += count;
+    } else if (count < 0 && errno != EAGAIN && errno != EINTR) {
+      lost_ = true;
+      return false;
+    } else if (!wait(POLLOUT, deadline) || lost_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+ssize_t SerialPort::read(
+  uint8_t * data, const std::size_t size, const std::chrono::steady_clock::time_point deadline)
+{
+  while (true) {
+    const ssize_t count = ::read(fd_, data, size);
+    if (count > 0) {
+      return count;
+    } else if (count < 0 && errno != EAGAIN && errno != EINTR) {
+      lost_ = true;
+      return -1;
+    }
+    if (!wait(POLLIN, deadline)) {
+      return 0;
+    }
+    if (lost_) {
+      return -1;
+    }
+  }
+}
+
+bool SerialPort::wait(const short events, const std::chrono::steady_clock::time_point deadline)
+{
+  const auto remaining = deadline - std::chrono::steady_clock::now();
+  if (remaining <= std::chrono::steady_clock::duration::zero()) {
+    return false;
+  }
+  const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+  struct timespec timeout;
+  timeout.tv_sec = seconds.count();
+  timeout.tv_nsec =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - seconds).count();
+  struct pollfd descriptor = {fd_, events, 0};
+  // a timeout or a signal is checked against the deadline on the next call
+  if (
+    ppoll(&descriptor, 1, &timeout, nullptr) > 0 &&
+    descriptor.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    lost_ = true;
+  }
+  return true;
+}
+
+std::chrono::nanoseconds SerialPort::transfer_time(const std::size_t size) const
+{
+  return std::chrono::nanoseconds(
+    static_cast<int64_t>(size) * kBitsPerByte * 1000000000 / std::max(baud_rate_, 1));
+}
+}  // namespace dynamixel_hardware
@@ -0,0 +1,107 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamixel_hardware/setpoint_queue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace dynamixel_hardware
+{
+void SetpointQueue::configure(const std::size_t width, const std::size_t capacity)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  width_ = width;
+  capacity_ = capacity;
+  head_ = 0;
+  size_ = 0;
+  underruns_ = 0;
+  times_.assign(capacity, Clock::time_point());
+  values_.assign(capacity * width, 0.0);
+}
+
+void SetpointQueue::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  head_ = 0;
+  size_ = 0;
+}
+
+void SetpointQueue::push(const Clock::time_point time, const double * values)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (capacity_ == 0) {
+    return;
+  }
+  if (size_ == capacity_) {
+    head_ = (head_ + 1) % capacity_;
+    size_--;
+  }
+  const std::size_t tail = (head_ + size_) % capacity_;
+  times_[tail] = time;
+  std::copy_n(values, width_, &values_[tail * width_]);
+  size_++;
+}
+
+bool SetpointQueue::sample(const Clock::time_point time, double * values)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (size_ == 0) {
+    return false;
+  }
+
+  // drop the setpoints of segments that have passed
+  while (size_ > 1 && times_[(head_ + 1) % capacity_] <= time) {
+    head_ = (head_ + 1) % capacity_;
+    size_--;
+  }
+
+  const double * from = row(0);
+  if (size_ == 1 || time <= times_[head_]) {
+    if (size_ == 1 && time > times_[head_]) {
+      underruns_++;
+    }
+    std::copy_n(from, width_, values);
+    return true;
+  }
+
+  const double * to = row(1);
+  const double ratio = std::chrono::duration<double>(time - times_[head_]).count() /
+                       std::chrono::duration<double>(times_[(head_ + 1) % capacity_] -
+                                                     times_[head_])
+                         .count();
+  for (std::size_t i = 0; i < width_; i++) {
+    values[i] = from[i] + (to[i] - from[i]) * ratio;
+  }
+  return true;
+}
+
+std::size_t SetpointQueue::depth()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
+}
+
+uint64_t SetpointQueue::underruns()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return underruns_;
+}
+
+const double * SetpointQueue::row(const std::size_t index) const
+{
+  return &values_[((head_ + index) % capacity_) * width_];
+}
+}  // namespace dynamixel_hardware
@@ -0,0 +1,200 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamixel_hardware/state_snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace dynamixel_hardware
+{
+// a writer stalls a reader for one copy of the records at most, a few tries are plenty
+constexpr int kSnapshotLoadTries = 1000;
+constexpr std::size_t kSequenceOffset = offsetof(SnapshotHeader, sequence);
+constexpr std::size_t kSequenceEnd = kSequenceOffset + sizeof(uint64_t);
+
+namespace
+{
+SnapshotJoint * joint_records(void * memory)
+{
+  return reinterpret_cast<SnapshotJoint *>(static_cast<uint8_t *>(memory) + sizeof(SnapshotHeader));
+}
+}  // namespace
+
+StateSnapshot::~StateSnapshot() { close(); }
+
+bool StateSnapshot::create(
+  const std::string & name, const uint32_t joint_count, std::string & error)
+{
+  close();
+  // a new segment instead of the old one, which its readers keep until they attach again
+  shm_unlink(name.c_str());
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    error = "shm_open " + name + ": " + std::strerror(errno);
+    return false;
+  }
+  const std::size_t size = sizeof(SnapshotHeader) + joint_count * sizeof(SnapshotJoint);
+  if (ftruncate(fd, size) != 0) {
+    error = "ftruncate " + name + ": " + std::strerror(errno);
+    ::close(fd);
+    return false;
+  }
+  void * memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (memory == MAP_FAILED) {
+    error = "mmap " + name + ": " + std::strerror(errno);
+    return false;
+  }
+
+  // the new segment is zero filled, magic included
+  name_ = name;
+  owner_ = true;
+  size_ = size;
+  header_ = static_cast<SnapshotHeader *>(memory);
+  joints_ = joint_records(memory);
+  header_->version = kSnapshotVersion;
+  header_->header_size = sizeof(SnapshotHeader);
+  header_->joint_size = sizeof(SnapshotJoint);
+  header_->joint_count = joint_count;
+  return true;
+}
+
+void StateSnapshot::publish()
+{
+  // readers check magic first and the rest after it
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->magic = kSnapshotMagic;
+}
+
+bool StateSnapshot::attach(const std::string & name, std::string & error)
+{
+  close();
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    error = "shm_open " + name + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat status;
+  if (
+    fstat(fd, &status) != 0 ||
+    static_cast<std::size_t>(status.st_size) < sizeof(SnapshotHeader)) {
+    error = name + " is not a state snapshot";
+    ::close(fd);
+    return false;
+  }
+  const std::size_t size = status.st_size;
+  inode_ = status.st_ino;
+  void * memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (memory == MAP_FAILED) {
+    error = "mmap " + name + ": " + std::strerror(errno);
+    return false;
+  }
+
+  const auto header = static_cast<SnapshotHeader *>(memory);
+  const bool published = header->magic == kSnapshotMagic;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (!published) {
+    error = name + " is not published yet";
+    munmap(memory, size);
+    return false;
+  }
+  if (
+    header->version != kSnapshotVersion ||
+    header->header_size != sizeof(SnapshotHeader) ||
+    header->joint_size != sizeof(SnapshotJoint) ||
+    size < sizeof(SnapshotHeader) + header->joint_count * sizeof(SnapshotJoint)) {
+    error = name + " has an unknown state snapshot layout";
+    munmap(memory, size);
+    return false;
+  }
+
+  name_ = name;
+  owner_ = false;
+  size_ = size;
+  header_ = header;
+  joints_ = joint_records(memory);
+  return true;
+}
+
+bool StateSnapshot::replaced() const
+{
+  const int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return true;
+  }
+  struct stat status;
+  const bool same = fstat(fd, &status) == 0 && static_cast<uint64_t>(status.st_ino) == inode_;
+  ::close(fd);
+  return !same;
+}
+
+void StateSnapshot::close()
+{
+  if (header_ == nullptr) {
+    return;
+  }
+  munmap(header_, size_);
+  if (owner_) {
+    // readers that are attached keep their mapping
+    shm_unlink(name_.c_str());
+  }
+  header_ = nullptr;
+  joints_ = nullptr;
+  size_ = 0;
+}
+
+void StateSnapshot::begin_write()
+{
+  header_->sequence.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void StateSnapshot::end_write()
+{
+  header_->sequence.fetch_add(1, std::memory_order_release);
+}
+
+bool StateSnapshot::load(
+  SnapshotHeader & header, SnapshotJoint * joints, const uint32_t joint_count) const
+{
+  const uint32_t count = std::min(joint_count, header_->joint_count);
+  for (int i = 0; i < kSnapshotLoadTries; i++) {
+    const uint64_t sequence = header_->sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      continue;
+    }
+    // everything around the atomic is plain data
+    uint8_t * to = reinterpret_cast<uint8_t *>(&header);
+    const uint8_t * from = reinterpret_cast<const uint8_t *>(header_);
+    std::memcpy(to, from, kSequenceOffset);
+    std::memcpy(to + kSequenceEnd, from + kSequenceEnd, sizeof(SnapshotHeader) - kSequenceEnd);
+    std::memcpy(joints, joints_, count * sizeof(SnapshotJoint));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header_->sequence.load(std::memory_order_relaxed) == sequence) {
+      header.sequence.store(sequence, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace dynamixel_hardware
@@ -0,0 +1,129 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "dynamixel_hardware/protocol1.hpp"
+
+namespace
+{
+using dynamixel_hardware::BulkEntry;
+using dynamixel_hardware::Protocol1;
+using dynamixel_hardware::StatusPacket;
+
+std::vector<uint8_t> packet(const Protocol1 & protocol, const std::size_t size)
+{
+  return std::vector<uint8_t>(protocol.tx(), protocol.tx() + size);
+}
+
+void receive(Protocol1 & protocol, const std::vector<uint8_t> & data)
+{
+  std::size_t available = 0;
+  uint8_t * space = protocol.rx_space(available);
+  ASSERT_GE(available, data.size());
+  std::copy(data.begin(), data.end(), space);
+  protocol.received(data.size());
+}
+}  // namespace
+
+// the examples of the Protocol 1.0 e-Manual
+TEST(Protocol1, BuildsRead)
+{
+  Protocol1 protocol;
+  const std::size_t size = protocol.read(1, 0x2b, 1);
+  EXPECT_EQ(
+    packet(protocol, size), std::vector<uint8_t>({0xff, 0xff, 0x01, 0x04, 0x02, 0x2b, 0x01, 0xcc}));
+}
+
+TEST(Protocol1, BuildsWrite)
+{
+  Protocol1 protocol;
+  const uint8_t data[] = {0x01};
+  const std::size_t size = protocol.write(dynamixel_hardware::kBroadcastId, 0x03, data, 1);
+  EXPECT_EQ(
+    packet(protocol, size), std::vector<uint8_t>({0xff, 0xff, 0xfe, 0x04, 0x03, 0x03, 0x01, 0xf6}));
+}
+
+TEST(Protocol1, BuildsSyncWrite)
+{
+  Protocol1 protocol;
+  const uint8_t params[] = {0x00, 0x10, 0x00, 0x50, 0x01, 0x01, 0x20, 0x02, 0x60, 0x03,
+                            0x02, 0x30, 0x00, 0x70, 0x01, 0x03, 0x20, 0x02, 0x80, 0x03};
+  const std::size_t size = protocol.sync_write(0x1e, 4, params, 4);
+  EXPECT_EQ(
+    packet(protocol, size),
+    std::vector<uint8_t>({0xff, 0xff, 0xfe, 0x18, 0x83, 0x1e, 0x04, 0x00, 0x10, 0x00, 0x50,
+                          0x01, 0x01, 0x20, 0x02, 0x60, 0x03, 0x02, 0x30, 0x00, 0x70, 0x01,
+                          0x03, 0x20, 0x02, 0x80, 0x03, 0x12}));
+}
+
+TEST(Protocol1, BuildsBulkRead)
+{
+  Protocol1 protocol;
+  const BulkEntry entries[] = {{1, 0x1e, 2}, {2, 0x24, 2}};
+  const std::size_t size = protocol.bulk_read(entries, 2);
+  EXPECT_EQ(
+    packet(protocol, size),
+    std::vector<uint8_t>(
+      {0xff, 0xff, 0xfe, 0x09, 0x92, 0x00, 0x02, 0x01, 0x1e, 0x02, 0x02, 0x24, 0x1d}));
+}
+
+TEST(Protocol1, RejectsOversizedPackets)
+{
+  Protocol1 protocol;
+  std::vector<uint8_t> params(3 * 127, 0);
+  EXPECT_EQ(protocol.sync_write(0x1e, 2, params.data(), 127), 0u);
+  std::vector<BulkEntry> entries(85, BulkEntry{1, 0x24, 2});
+  EXPECT_EQ(protocol.bulk_read(entries.data(), entries.size()), 0u);
+}
+
+TEST(Protocol1, ParsesStatusPackets)
+{
+  Protocol1 protocol;
+  // noise, an acknowledgement of id 1 and the Present_Temperature of id 2 in two parts
+  const std::vector<uint8_t> data = {0x13, 0xff, 0xff, 0x01, 0x02, 0x00, 0xfc,
+                                     0xff, 0xff, 0x02, 0x03, 0x24, 0x20, 0xb6};
+  receive(protocol, std::vector<uint8_t>(data.begin(), data.end() - 2));
+
+  StatusPacket status;
+  ASSERT_TRUE(protocol.next_status(status));
+  EXPECT_EQ(status.id, 1);
+  EXPECT_EQ(status.error, 0x00);
+  EXPECT_EQ(status.length, 0);
+  EXPECT_FALSE(protocol.next_status(status));
+
+  receive(protocol, std::vector<uint8_t>(data.end() - 2, data.end()));
+  ASSERT_TRUE(protocol.next_status(status));
+  EXPECT_EQ(status.id, 2);
+  EXPECT_EQ(status.error, 0x24);
+  ASSERT_EQ(status.length, 1);
+  EXPECT_EQ(status.params[0], 0x20);
+  EXPECT_EQ(protocol.corrupt_packets(), 0u);
+}
+
+TEST(Protocol1, SkipsCorruptPackets)
+{
+  Protocol1 protocol;
+  receive(
+    protocol, {0xff, 0xff, 0x01, 0x03, 0x00, 0x20, 0xdc, 0xff, 0xff, 0x01, 0x03, 0x00, 0x20, 0xdb});
+  StatusPacket status;
+  ASSERT_TRUE(protocol.next_status(status));
+  EXPECT_EQ(status.id, 1);
+  EXPECT_EQ(status.params[0], 0x20);
+  EXPECT_EQ(protocol.corrupt_packets(), 1u);
+}
@@ -0,0 +1,232 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "dynamixel_hardware/protocol2.hpp"
+
+namespace
+{
+using dynamixel_hardware::BulkEntry;
+using dynamixel_hardware::Protocol2;
+using dynamixel_hardware::StatusPacket;
+
+std::vector<uint8_t> packet(const Protocol2 & protocol, const std::size_t size)
+{
+  return std::vector<uint8_t>(protocol.tx(), protocol.tx() + size);
+}
+
+// a status packet of id with the parameters after the error byte, CRC appended
+std::vector<uint8_t> status_packet(
+  const uint8_t id, const uint8_t error, const std::vector<uint8_t> & params)
+{
+  const uint16_t length = params.size() + 4;
+  std::vector<uint8_t> data = {0xff, 0xff, 0xfd, 0x00, id, static_cast<uint8_t>(length & 0xff),
+                               static_cast<uint8_t>(length >> 8), 0x55, error};
+  data.insert(data.end(), params.begin(), params.end());
+  const uint16_t crc = dynamixel_hardware::update_crc(0, data.data(), data.size());
+  data.push_back(crc & 0xff);
+  data.push_back(crc >> 8);
+  return data;
+}
+
+void receive(Protocol2 & protocol, const std::vector<uint8_t> & data)
+{
+  std::size_t available = 0;
+  uint8_t * space = protocol.rx_space(available);
+  ASSERT_GE(available, data.size());
+  std::copy(data.begin(), data.end(), space);
+  protocol.received(data.size());
+}
+}  // namespace
+
+// the examples of the Protocol 2.0 e-Manual
+TEST(Protocol2, Crc)
+{
+  const uint8_t ping[] = {0xff, 0xff, 0xfd, 0x00, 0x01, 0x03, 0x00, 0x01};
+  EXPECT_EQ(dynamixel_hardware::update_crc(0, ping, sizeof(ping)), 0x4e19);
+  // continued over two parts
+  const uint16_t crc = dynamixel_hardware::update_crc(0, ping, 3);
+  EXPECT_EQ(dynamixel_hardware::update_crc(crc, ping + 3, sizeof(ping) - 3), 0x4e19);
+}
+
+TEST(Protocol2, BuildsRead)
+{
+  Protocol2 protocol;
+  const std::size_t size = protocol.read(1, 132, 4);
+  EXPECT_EQ(
+    packet(protocol, size),
+    std::vector<uint8_t>(
+      {0xff, 0xff, 0xfd, 0x00, 0x01, 0x07, 0x00, 0x02, 0x84, 0x00, 0x04, 0x00, 0x1d, 0x15}));
+}
+
+TEST(Protocol2, BuildsWrite)
+{
+  Protocol2 protocol;
+  const uint8_t data[] = {0x00, 0x02, 0x00, 0x00};
+  const std::size_t size = protocol.write(1, 116, data, sizeof(data));
+  EXPECT_EQ(
+    packet(protocol, size),
+    std::vector<uint8_t>({0xff, 0xff, 0xfd, 0x00, 0x01, 0x09, 0x00, 0x03, 0x74, 0x00, 0x00,
+                          0x02, 0x00, 0x00, 0xca, 0x89}));
+}
+
+TEST(Protocol2, BuildsSyncRead)
+{
+  Protocol2 protocol;
+  const uint8_t ids[] = {1, 2};
+  const std::size_t size = protocol.sync_read(132, 4, ids, 2);
+  EXPECT_EQ(
+    packet(protocol, size),
+    std::vector<uint8_t>({0xff, 0xff, 0xfd, 0x00, 0xfe, 0x09, 0x00, 0x82, 0x84, 0x00, 0x04,
+                          0x00, 0x01, 0x02, 0xce, 0xfa}));
+  // the same with the Fast Sync Read instruction and its own CRC
+  const std::size_t fast_size = protocol.sync_read(132, 4, ids, 2, true);
+  ASSERT_EQ(fast_size, size);
+  EXPECT_EQ(protocol.tx()[7], dynamixel_hardware::kInstructionFastSyncRead);
+  EXPECT_EQ(
+    dynamixel_hardware::update_crc(0, protocol.tx(), size - 2),
+    protocol.tx()[size - 2] | (protocol.tx()[size - 1] << 8));
+}
+
+TEST(Protocol2, BuildsSyncWrite)
+{
+  Protocol2 protocol;
+  const uint8_t params[] = {0x01, 0x96, 0x00, 0x00, 0x00, 0x02, 0xaa, 0x00, 0x00, 0x00};
+  const std::size_t size = protocol.sync_write(116, 4, params, 2);
+  EXPECT_EQ(
+    packet(protocol, size),
+    std::vector<uint8_t>({0xff, 0xff, 0xfd, 0x00, 0xfe, 0x11, 0x00, 0x83, 0x74, 0x00, 0x04,
+                          0x00, 0x01, 0x96, 0x00, 0x00, 0x00, 0x02, 0xaa, 0x00, 0x00, 0x00,
+                          0x82, 0x87}));
+}
+
+TEST(Protocol2, BuildsBulkPackets)
+{
+  Protocol2 protocol;
+  const BulkEntry entries[] = {{1, 144, 2}, {2, 132, 4}};
+  const std::size_t read_size = protocol.bulk_read(entries, 2);
+  ASSERT_EQ(read_size, 10u + 10u);
+  EXPECT_EQ(protocol.tx()[7], dynamixel_hardware::kInstructionBulkRead);
+  EXPECT_EQ(
+    std::vector<uint8_t>(protocol.tx() + 8, protocol.tx() + 18),
+    std::vector<uint8_t>({0x01, 0x90, 0x00, 0x02, 0x00, 0x02, 0x84, 0x00, 0x04, 0x00}));
+
+  const uint8_t data[] = {0x10, 0x20, 0x01, 0x02, 0x03, 0x04};
+  const std::size_t write_size = protocol.bulk_write(entries, data, 2);
+  ASSERT_EQ(write_size, 10u + 16u);
+  EXPECT_EQ(protocol.tx()[7], dynamixel_hardware::kInstructionBulkWrite);
+  EXPECT_EQ(
+    std::vector<uint8_t>(protocol.tx() + 8, protocol.tx() + 24),
+    std::vector<uint8_t>({0x01, 0x90, 0x00, 0x02, 0x00, 0x10, 0x20, 0x02, 0x84, 0x00, 0x04, 0x00,
+                          0x01, 0x02, 0x03, 0x04}));
+}
+
+TEST(Protocol2, StuffsHeaderPattern)
+{
+  Protocol2 protocol;
+  // FF FF FD in the parameters goes out as FF FF FD FD, the length counts the extra byte
+  const uint8_t params[] = {0x01, 0xff, 0xff, 0xfd, 0x00};
+  const std::size_t size = protocol.sync_write(0x100, 4, params, 1);
+  ASSERT_EQ(size, 10u + 4u + 5u + 1u);
+  EXPECT_EQ(
+    std::vector<uint8_t>(protocol.tx() + 8, protocol.tx() + size - 2),
+    std::vector<uint8_t>({0x00, 0x01, 0x04, 0x00, 0x01, 0xff, 0xff, 0xfd, 0xfd, 0x00}));
+  EXPECT_EQ(protocol.tx()[5] | (protocol.tx()[6] << 8), 4 + 5 + 1 + 3);
+  EXPECT_EQ(
+    dynamixel_hardware::update_crc(0, protocol.tx(), size - 2),
+    protocol.tx()[size - 2] | (protocol.tx()[size - 1] << 8));
+}
+
+TEST(Protocol2, ParsesStatusPackets)
+{
+  Protocol2 protocol;
+  std::vector<uint8_t> data = {0x00, 0x13};
+  const std::vector<uint8_t> first = status_packet(1, 0x00, {0xa6, 0x00, 0x00, 0x00});
+  const std::vector<uint8_t> second = status_packet(2, 0x80, {0x1f, 0x08});
+  data.insert(data.end(), first.begin(), first.end());
+  data.insert(data.end(), second.begin(), second.end());
+  // the second packet arrives in two parts
+  const std::size_t split = data.size() - 3;
+  receive(protocol, std::vector<uint8_t>(data.begin(), data.begin() + split));
+
+  StatusPacket status;
+  ASSERT_TRUE(protocol.next_status(status));
+  EXPECT_EQ(status.id, 1);
+  EXPECT_EQ(status.error, 0x00);
+  ASSERT_EQ(status.length, 4);
+  EXPECT_EQ(
+    std::vector<uint8_t>(status.params, status.params + 4),
+    std::vector<uint8_t>({0xa6, 0x00, 0x00, 0x00}));
+  EXPECT_FALSE(protocol.next_status(status));
+
+  receive(protocol, std::vector<uint8_t>(data.begin() + split, data.end()));
+  ASSERT_TRUE(protocol.next_status(status));
+  EXPECT_EQ(status.id, 2);
+  EXPECT_EQ(status.error, 0x80);
+  ASSERT_EQ(status.length, 2);
+  EXPECT_EQ(status.params[0], 0x1f);
+  EXPECT_EQ(status.params[1], 0x08);
+  EXPECT_FALSE(protocol.next_status(status));
+  EXPECT_EQ(protocol.corrupt_packets(), 0u);
+}
+
+TEST(Protocol2, UnstuffsStatusPackets)
+{
+  Protocol2 protocol;
+  // the servo stuffs FF FF FD in its data, the length counts the stuffed bytes
+  receive(protocol, status_packet(3, 0x00, {0xff, 0xff, 0xfd, 0xfd, 0x01}));
+  StatusPacket status;
+  ASSERT_TRUE(protocol.next_status(status));
+  EXPECT_EQ(status.id, 3);
+  EXPECT_EQ(
+    std::vector<uint8_t>(status.params, status.params + status.length),
+    std::vector<uint8_t>({0xff, 0xff, 0xfd, 0x01}));
+}
+
+TEST(Protocol2, SkipsCorruptPackets)
+{
+  Protocol2 protocol;
+  std::vector<uint8_t> corrupt = status_packet(1, 0x00, {0x01, 0x02});
+  corrupt.back() ^= 0xff;
+  const std::vector<uint8_t> good = status_packet(2, 0x00, {0x03, 0x04});
+  corrupt.insert(corrupt.end(), good.begin(), good.end());
+  receive(protocol, corrupt);
+
+  StatusPacket status;
+  ASSERT_TRUE(protocol.next_status(status));
+  EXPECT_EQ(status.id, 2);
+  EXPECT_EQ(status.params[0], 0x03);
+  EXPECT_EQ(protocol.corrupt_packets(), 1u);
+}
+
+TEST(Protocol2, SplitsFastSyncReadStatus)
+{
+  // error, id, 2 data bytes and CRC per servo, the CRC of the last one is the packet's
+  const uint8_t data[] = {0x00, 0x01, 0x10, 0x11, 0xaa, 0xbb, 0x00, 0x02, 0x20, 0x21};
+  StatusPacket status;
+  status.id = dynamixel_hardware::kBroadcastId;
+  status.error = data[0];
+  status.params = data + 1;
+  status.length = sizeof(data) - 1;
+  ASSERT_EQ(Protocol2::fast_sync_count(status, 2), 2u);
+  const uint8_t * second = Protocol2::fast_sync_entry(status, 2, 1);
+  EXPECT_EQ(second[1], 0x02);
+  EXPECT_EQ(second[2], 0x20);
+  EXPECT_EQ(second[3], 0x21);
+}
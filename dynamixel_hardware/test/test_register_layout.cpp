@@ -0,0 +1,125 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#include "dynamixel_hardware/register_layout.hpp"
+
+using dynamixel_hardware::MultiTurnPosition;
+using dynamixel_hardware::ValueScale;
+using dynamixel_hardware::get_value;
+using dynamixel_hardware::set_value;
+using dynamixel_hardware::unwrap;
+
+TEST(RegisterLayout, GetsLittleEndianValues)
+{
+  const uint8_t data[] = {0x34, 0x12, 0xfe, 0xff};
+  EXPECT_EQ(get_value(data, 1), 0x34);
+  EXPECT_EQ(get_value(data, 2), 0x1234);
+  EXPECT_EQ(get_value(data + 2, 2), 0xfffe);
+  EXPECT_EQ(get_value(data, 4), static_cast<int32_t>(0xfffe1234));
+  EXPECT_EQ(get_value(data, 3), 0);
+}
+
+TEST(RegisterLayout, SetsLittleEndianValues)
+{
+  uint8_t data[4] = {};
+  set_value(data, 4, -2);
+  EXPECT_EQ(get_value(data, 4), -2);
+  set_value(data, 2, -2);
+  EXPECT_EQ(data[0], 0xfe);
+  EXPECT_EQ(data[1], 0xff);
+  // only length bytes are written
+  set_value(data, 1, 0x1ff);
+  EXPECT_EQ(data[0], 0xff);
+  EXPECT_EQ(data[1], 0xff);
+  EXPECT_EQ(data[2], 0xff);
+}
+
+TEST(RegisterLayout, ConvertsPositions)
+{
+  ValueScale scale;
+  scale.zero_position = 2048.0;
+  scale.max_position_ratio = M_PI / 2047.0;
+  scale.min_position_ratio = -M_PI / -2048.0;
+  EXPECT_DOUBLE_EQ(dynamixel_hardware::to_radian(scale, 2048), 0.0);
+  EXPECT_NEAR(dynamixel_hardware::to_radian(scale, 4095), M_PI, 1e-12);
+  EXPECT_NEAR(dynamixel_hardware::to_radian(scale, 0), -M_PI, 1e-12);
+  for (int32_t value : {0, 1, 1000, 2047, 2048, 2049, 3000, 4095}) {
+    // from_radian() truncates like the workbench
+    const double radian = dynamixel_hardware::to_radian(scale, value);
+    EXPECT_LE(std::abs(dynamixel_hardware::from_radian(scale, radian) - value), 1) << value;
+  }
+}
+
+TEST(RegisterLayout, ConvertsSignedCurrent)
+{
+  ValueScale scale;
+  scale.current_unit = 2.69;
+  EXPECT_DOUBLE_EQ(dynamixel_hardware::to_current(scale, 0xffff), -2.69);
+  EXPECT_EQ(dynamixel_hardware::from_current(scale, -2.69), -1);
+}
+
+TEST(RegisterLayout, UnwrapsAcrossTheRegister)
+{
+  MultiTurnPosition position;
+  position.turn = 4096;
+  EXPECT_EQ(unwrap(position, 100, 4), 100);
+  EXPECT_EQ(unwrap(position, -100, 4), -100);
+  // Present_Position of 4 bytes wraps around at 2^31
+  MultiTurnPosition wide;
+  wide.turn = 4096;
+  EXPECT_EQ(unwrap(wide, 0x7ffffff0, 4), 0x7ffffff0);
+  EXPECT_EQ(unwrap(wide, static_cast<int32_t>(0x80000010), 4), 0x80000010LL);
+  // and one of 2 bytes at 2^15
+  MultiTurnPosition narrow;
+  narrow.turn = 4096;
+  EXPECT_EQ(unwrap(narrow, 0x7ff0, 2), 0x7ff0);
+  EXPECT_EQ(unwrap(narrow, 0x8010, 2), 0x8010);
+  EXPECT_EQ(unwrap(narrow, 0x7ff0, 2), 0x7ff0);
+}
+
+TEST(RegisterLayout, UnwrapsARebaseWithinATurn)
+{
+  MultiTurnPosition position;
+  position.turn = 4096;
+  EXPECT_EQ(unwrap(position, 3 * 4096 + 100, 4), 3 * 4096 + 100);
+  // the servo restarted and counts within one turn again, just past the last position
+  position.rebase = true;
+  EXPECT_EQ(unwrap(position, 150, 4), 3 * 4096 + 150);
+  EXPECT_FALSE(position.rebase);
+  // and across the wraparound of the turn
+  position.rebase = true;
+  EXPECT_EQ(unwrap(position, 4000, 4), 3 * 4096 - 96);
+  EXPECT_EQ(unwrap(position, 4010, 4), 3 * 4096 - 86);
+}
+
+TEST(RegisterLayout, ConvertsMultiTurnGoals)
+{
+  ValueScale scale;
+  scale.zero_position = 2048.0;
+  MultiTurnPosition position;
+  position.turn = 4096;
+  position.ratio = 2.0 * M_PI / 4096;
+  unwrap(position, 2 * 4096 + 2048, 4);
+  EXPECT_NEAR(dynamixel_hardware::to_radian(scale, position), 4.0 * M_PI, 1e-12);
+  // after a restart the goal is in the servo's new count of turns
+  position.rebase = true;
+  unwrap(position, 2048, 4);
+  EXPECT_EQ(dynamixel_hardware::from_radian(scale, position, 4.0 * M_PI + 0.5 * M_PI), 3072);
+}
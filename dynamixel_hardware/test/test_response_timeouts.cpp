@@ -0,0 +1,117 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+
+#include "dynamixel_hardware/response_timeouts.hpp"
+
+using dynamixel_hardware::ResponseTimeouts;
+using dynamixel_hardware::Transaction;
+using std::chrono::microseconds;
+
+namespace
+{
+void add_samples(
+  ResponseTimeouts & timeouts, const Transaction transaction, const std::size_t joint,
+  const uint32_t count, const microseconds round_trip)
+{
+  for (uint32_t k = 0; k < count; k++) {
+    timeouts.add(transaction, joint, round_trip);
+  }
+}
+}  // namespace
+
+TEST(ResponseTimeouts, LearnsAfterWarmup)
+{
+  ResponseTimeouts timeouts;
+  timeouts.configure(2, microseconds(100), microseconds(10000), microseconds(200));
+  add_samples(
+    timeouts, Transaction::SyncRead, 0, ResponseTimeouts::kWarmupSamples - 1, microseconds(1000));
+  EXPECT_EQ(timeouts.timeout(Transaction::SyncRead, 0).count(), 0);
+  timeouts.add(Transaction::SyncRead, 0, microseconds(1000));
+
+  // the upper edge of the 1/8 octave bin of 1 ms plus the margin
+  const auto timeout = timeouts.timeout(Transaction::SyncRead, 0);
+  EXPECT_GE(timeout, microseconds(1200));
+  EXPECT_LE(timeout, microseconds(1291));
+  // per joint and transaction
+  EXPECT_EQ(timeouts.timeout(Transaction::SyncRead, 1).count(), 0);
+  EXPECT_EQ(timeouts.timeout(Transaction::SyncReadRetry, 0).count(), 0);
+}
+
+TEST(ResponseTimeouts, FollowsTheQuantile)
+{
+  ResponseTimeouts timeouts;
+  timeouts.configure(1, microseconds(0), microseconds(100000), microseconds(0));
+  // one slow answer in 112 is beyond the 99th percentile, 17 in 128 are not
+  add_samples(timeouts, Transaction::Read, 0, 111, microseconds(500));
+  add_samples(timeouts, Transaction::Read, 0, 1, microseconds(5000));
+  EXPECT_LT(timeouts.timeout(Transaction::Read, 0), microseconds(600));
+  add_samples(timeouts, Transaction::Read, 0, 16, microseconds(5000));
+  EXPECT_GE(timeouts.timeout(Transaction::Read, 0), microseconds(5000));
+}
+
+TEST(ResponseTimeouts, ClampsToTheLimits)
+{
+  ResponseTimeouts timeouts;
+  timeouts.configure(1, microseconds(500), microseconds(2000), microseconds(200));
+  add_samples(
+    timeouts, Transaction::SyncRead, 0, ResponseTimeouts::kWarmupSamples, microseconds(10));
+  EXPECT_EQ(timeouts.timeout(Transaction::SyncRead, 0), microseconds(500));
+  add_samples(
+    timeouts, Transaction::BulkRead, 0, ResponseTimeouts::kWarmupSamples, microseconds(5000));
+  EXPECT_EQ(timeouts.timeout(Transaction::BulkRead, 0), microseconds(2000));
+}
+
+TEST(ResponseTimeouts, RelearnsAfterMisses)
+{
+  ResponseTimeouts timeouts;
+  timeouts.configure(1, microseconds(100), microseconds(10000), microseconds(200));
+  // misses before anything is learned do not count
+  timeouts.miss(Transaction::SyncRead, 0);
+  add_samples(
+    timeouts, Transaction::SyncRead, 0, ResponseTimeouts::kWarmupSamples, microseconds(1000));
+  ASSERT_GT(timeouts.timeout(Transaction::SyncRead, 0).count(), 0);
+
+  // an answer in between starts the count again
+  for (uint32_t k = 0; k + 1 < ResponseTimeouts::kMissLimit; k++) {
+    timeouts.miss(Transaction::SyncRead, 0);
+  }
+  timeouts.add(Transaction::SyncRead, 0, microseconds(1000));
+  for (uint32_t k = 0; k + 1 < ResponseTimeouts::kMissLimit; k++) {
+    timeouts.miss(Transaction::SyncRead, 0);
+  }
+  EXPECT_GT(timeouts.timeout(Transaction::SyncRead, 0).count(), 0);
+
+  timeouts.miss(Transaction::SyncRead, 0);
+  EXPECT_EQ(timeouts.timeout(Transaction::SyncRead, 0).count(), 0);
+  // and it warms up from scratch
+  add_samples(
+    timeouts, Transaction::SyncRead, 0, ResponseTimeouts::kWarmupSamples, microseconds(4000));
+  EXPECT_GE(timeouts.timeout(Transaction::SyncRead, 0), microseconds(4200));
+}
+
+TEST(ResponseTimeouts, Resets)
+{
+  ResponseTimeouts timeouts;
+  timeouts.configure(1, microseconds(100), microseconds(10000), microseconds(200));
+  add_samples(
+    timeouts, Transaction::FastSyncRead, 0, ResponseTimeouts::kWarmupSamples, microseconds(800));
+  ASSERT_GT(timeouts.timeout(Transaction::FastSyncRead, 0).count(), 0);
+  timeouts.reset();
+  EXPECT_EQ(timeouts.timeout(Transaction::FastSyncRead, 0).count(), 0);
+}
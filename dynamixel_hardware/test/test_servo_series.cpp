@@ -0,0 +1,170 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "dynamixel_hardware/register_layout.hpp"
+#include "dynamixel_hardware/servo_series.hpp"
+
+namespace
+{
+using dynamixel_hardware::GenericCodec;
+using dynamixel_hardware::RegisterLayout;
+using dynamixel_hardware::SeriesCodec;
+using dynamixel_hardware::ValueScale;
+
+// the layout and units configure() finds for the servos of a codec's series
+template<typename Codec, typename Series>
+struct Case
+{
+  using CodecType = Codec;
+
+  static RegisterLayout layout()
+  {
+    RegisterLayout layout;
+    layout.present_position.offset = Codec::kPositionOffset;
+    layout.present_position.length = Series::kPresentPositionLength;
+    layout.present_velocity.offset = Codec::kVelocityOffset;
+    layout.present_velocity.length = Series::kPresentVelocityLength;
+    layout.present_current.offset = Codec::kCurrentOffset;
+    layout.present_current.length = Series::kPresentCurrentLength;
+    layout.read_length = 10;
+    layout.goal_position.length = Series::kGoalPositionLength;
+    layout.goal_velocity.length = Series::kGoalVelocityLength;
+    layout.goal_current.length = Series::kGoalCurrentLength;
+    return layout;
+  }
+
+  static ValueScale scale()
+  {
+    ValueScale scale;
+    scale.zero_position = Series::kZeroPosition;
+    scale.max_position_ratio = Series::kMaxPositionRatio;
+    scale.min_position_ratio = Series::kMinPositionRatio;
+    scale.velocity_unit = Series::kVelocityUnit;
+    scale.current_unit = Series::kCurrentUnit;
+    scale.sign_magnitude = Series::kSignMagnitude;
+    return scale;
+  }
+};
+
+template<typename Series, bool Indirect>
+using SeriesCase = Case<SeriesCodec<Series, Indirect>, Series>;
+
+template<typename T>
+class ServoSeries : public ::testing::Test
+{
+};
+
+using Cases = ::testing::Types<
+  SeriesCase<dynamixel_hardware::XSeries, true>, SeriesCase<dynamixel_hardware::XSeries, false>,
+  SeriesCase<dynamixel_hardware::MX2Series, true>,
+  SeriesCase<dynamixel_hardware::MX2Series, false>,
+  SeriesCase<dynamixel_hardware::MX1Series, false>,
+  SeriesCase<dynamixel_hardware::AXSeries, false>>;
+TYPED_TEST_SUITE(ServoSeries, Cases);
+}  // namespace
+
+TYPED_TEST(ServoSeries, MatchesItsLayout)
+{
+  using Codec = typename TypeParam::CodecType;
+  EXPECT_TRUE(Codec::matches(TypeParam::layout(), TypeParam::scale()));
+  ValueScale other = TypeParam::scale();
+  other.current_unit *= 1.1;
+  EXPECT_FALSE(Codec::matches(TypeParam::layout(), other));
+  other = TypeParam::scale();
+  other.sign_magnitude = !other.sign_magnitude;
+  EXPECT_FALSE(Codec::matches(TypeParam::layout(), other));
+}
+
+TYPED_TEST(ServoSeries, DecodesLikeTheGenericCodec)
+{
+  using Codec = typename TypeParam::CodecType;
+  const RegisterLayout layout = TypeParam::layout();
+  const ValueScale scale = TypeParam::scale();
+  std::mt19937 random(1);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<uint8_t> data(layout.read_length);
+  for (int k = 0; k < 1000; k++) {
+    for (auto & value : data) {
+      value = static_cast<uint8_t>(byte(random));
+    }
+    double position[2], velocity[2], effort[2];
+    Codec::decode(data.data(), layout, scale, position[0], velocity[0], effort[0]);
+    GenericCodec::decode(data.data(), layout, scale, position[1], velocity[1], effort[1]);
+    ASSERT_DOUBLE_EQ(position[0], position[1]);
+    ASSERT_DOUBLE_EQ(velocity[0], velocity[1]);
+    ASSERT_DOUBLE_EQ(effort[0], effort[1]);
+  }
+}
+
+TYPED_TEST(ServoSeries, EncodesLikeTheGenericCodec)
+{
+  using Codec = typename TypeParam::CodecType;
+  const RegisterLayout layout = TypeParam::layout();
+  const ValueScale scale = TypeParam::scale();
+  std::mt19937 random(2);
+  std::uniform_real_distribution<double> position(-3.1, 3.1);
+  std::uniform_real_distribution<double> velocity(-5.0, 5.0);
+  std::uniform_real_distribution<double> current(-3000.0, 3000.0);
+  for (int k = 0; k < 1000; k++) {
+    uint8_t encoded[2][4] = {};
+    const double goal_position = position(random);
+    Codec::encode_position(encoded[0], layout, scale, goal_position);
+    GenericCodec::encode_position(encoded[1], layout, scale, goal_position);
+    ASSERT_EQ(
+      dynamixel_hardware::get_value(encoded[0], 4), dynamixel_hardware::get_value(encoded[1], 4));
+
+    const double goal_velocity = velocity(random);
+    Codec::encode_velocity(encoded[0], layout, scale, goal_velocity);
+    GenericCodec::encode_velocity(encoded[1], layout, scale, goal_velocity);
+    ASSERT_EQ(
+      dynamixel_hardware::get_value(encoded[0], 4), dynamixel_hardware::get_value(encoded[1], 4));
+
+    if (layout.goal_current.length > 0) {
+      const double goal_current = current(random);
+      Codec::encode_current(encoded[0], layout, scale, goal_current, 1000);
+      GenericCodec::encode_current(encoded[1], layout, scale, goal_current, 1000);
+      ASSERT_EQ(
+        dynamixel_hardware::get_value(encoded[0], 4),
+        dynamixel_hardware::get_value(encoded[1], 4));
+    }
+  }
+}
+
+TEST(GenericCodec, ConvertsTheProtocol1DirectionBit)
+{
+  using Codec = SeriesCodec<dynamixel_hardware::MX1Series, false>;
+  using MX1Case = Case<Codec, dynamixel_hardware::MX1Series>;
+  const RegisterLayout layout = MX1Case::layout();
+  const ValueScale scale = MX1Case::scale();
+  // Present_Position 2048, Present_Speed 100 clockwise, Present_Load 200 counterclockwise
+  const uint8_t data[10] = {0x00, 0x08, 0x64, 0x04, 0xc8, 0x00};
+  double position, velocity, effort;
+  GenericCodec::decode(data, layout, scale, position, velocity, effort);
+  EXPECT_DOUBLE_EQ(position, 0.0);
+  EXPECT_DOUBLE_EQ(velocity, -100 * dynamixel_hardware::MX1Series::kVelocityUnit);
+  EXPECT_DOUBLE_EQ(effort, 200 * dynamixel_hardware::MX1Series::kCurrentUnit);
+
+  uint8_t goal[2];
+  GenericCodec::encode_velocity(
+    goal, layout, scale, -100.5 * dynamixel_hardware::MX1Series::kVelocityUnit);
+  EXPECT_EQ(dynamixel_hardware::get_value(goal, 2), 0x400 | 100);
+  GenericCodec::encode_velocity(goal, layout, scale, 2000 * scale.velocity_unit);
+  EXPECT_EQ(dynamixel_hardware::get_value(goal, 2), 0x3ff);
+}
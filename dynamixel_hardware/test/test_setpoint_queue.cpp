@@ -0,0 +1,93 @@
+// Copyright 2020 Yutaka Kondo <yutaka.kondo@youtalk.jp>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include "dynamixel_hardware/setpoint_queue.hpp"
+
+using dynamixel_hardware::SetpointQueue;
+using std::chrono::milliseconds;
+
+TEST(SetpointQueue, SamplesNothingWhenEmpty)
+{
+  SetpointQueue queue;
+  queue.configure(2, 4);
+  double values[2] = {7.0, 7.0};
+  EXPECT_FALSE(queue.sample(SetpointQueue::Clock::now(), values));
+  EXPECT_EQ(values[0], 7.0);
+  EXPECT_EQ(queue.depth(), 0u);
+}
+
+TEST(SetpointQueue, Interpolates)
+{
+  SetpointQueue queue;
+  queue.configure(2, 4);
+  const auto start = SetpointQueue::Clock::now();
+  const double first[] = {0.0, 10.0};
+  const double second[] = {1.0, 20.0};
+  queue.push(start, first);
+  queue.push(start + milliseconds(10), second);
+
+  double values[2];
+  ASSERT_TRUE(queue.sample(start + milliseconds(5), values));
+  EXPECT_NEAR(values[0], 0.5, 1e-9);
+  EXPECT_NEAR(values[1], 15.0, 1e-9);
+  // before the first setpoint it is held
+  ASSERT_TRUE(queue.sample(start - milliseconds(5), values));
+  EXPECT_EQ(values[0], 0.0);
+  EXPECT_EQ(queue.depth(), 2u);
+  EXPECT_EQ(queue.underruns(), 0u);
+}
+
+TEST(SetpointQueue, HoldsTheNewestAndCountsUnderruns)
+{
+  SetpointQueue queue;
+  queue.configure(1, 4);
+  const auto start = SetpointQueue::Clock::now();
+  const double first[] = {1.0};
+  const double second[] = {2.0};
+  queue.push(start, first);
+  queue.push(start + milliseconds(10), second);
+
+  double value = 0.0;
+  ASSERT_TRUE(queue.sample(start + milliseconds(10), &value));
+  EXPECT_EQ(value, 2.0);
+  // the passed segment is dropped
+  EXPECT_EQ(queue.depth(), 1u);
+  EXPECT_EQ(queue.underruns(), 0u);
+  ASSERT_TRUE(queue.sample(start + milliseconds(20), &value));
+  EXPECT_EQ(value, 2.0);
+  EXPECT_EQ(queue.underruns(), 1u);
+}
+
+TEST(SetpointQueue, DropsTheOldestWhenFull)
+{
+  SetpointQueue queue;
+  queue.configure(1, 2);
+  const auto start = SetpointQueue::Clock::now();
+  for (int k = 0; k < 3; k++) {
+    const double value = k;
+    queue.push(start + milliseconds(10 * k), &value);
+  }
+  EXPECT_EQ(queue.depth(), 2u);
+  double value = -1.0;
+  ASSERT_TRUE(queue.sample(start, &value));
+  EXPECT_EQ(value, 1.0);
+
+  queue.clear();
+  EXPECT_EQ(queue.depth(), 0u);
+  EXPECT_FALSE(queue.sample(start, &value));
+}